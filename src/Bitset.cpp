@@ -0,0 +1,88 @@
+#include "Bitset.h"
+
+void Bitset::resize(uint32_t bitCount) {
+  bits = bitCount;
+  data.assign((bitCount + WORD_BITS - 1) / WORD_BITS, 0);
+}
+
+void Bitset::reset() {
+  bits = 0;
+  std::vector<uint32_t>().swap(data);
+}
+
+void Bitset::setRange(uint32_t from, uint32_t count) {
+  if (from >= bits) return;
+  const uint32_t end = count > bits - from ? bits : from + count;
+  while (from < end) {
+    const uint32_t shift = from % WORD_BITS;
+    const uint32_t n = end - from < WORD_BITS - shift ? end - from : WORD_BITS - shift;
+    const uint32_t mask = n == WORD_BITS ? ~0u : ((1u << n) - 1) << shift;
+    data[from / WORD_BITS] |= mask;
+    from += n;
+  }
+}
+
+void Bitset::clearAll() {
+  for (uint32_t& w : data) {
+    w = 0;
+  }
+}
+
+void Bitset::trim() {
+  if (bits % WORD_BITS) {
+    data.back() &= (1u << (bits % WORD_BITS)) - 1;
+  }
+}
+
+uint32_t Bitset::count() const {
+  uint32_t total = 0;
+  for (uint32_t w : data) {
+    total += __builtin_popcount(w);
+  }
+  return total;
+}
+
+uint32_t Bitset::countAndNot(const Bitset& other, uint32_t otherWord) const {
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < wordCount(); i++) {
+    const uint32_t j = otherWord + i;
+    const uint32_t mask = j < other.wordCount() ? other.data[j] : 0;
+    total += __builtin_popcount(data[i] & ~mask);
+  }
+  return total;
+}
+
+void Bitset::andNot(const Bitset& other, uint32_t otherWord) {
+  for (uint32_t i = 0; i < wordCount() && otherWord + i < other.wordCount(); i++) {
+    data[i] &= ~other.data[otherWord + i];
+  }
+}
+
+void Bitset::intersect(const Bitset& other) {
+  for (uint32_t i = 0; i < wordCount(); i++) {
+    data[i] &= i < other.wordCount() ? other.data[i] : 0;
+  }
+}
+
+void Bitset::unite(const Bitset& other) {
+  for (uint32_t i = 0; i < wordCount() && i < other.wordCount(); i++) {
+    data[i] |= other.data[i];
+  }
+  trim();
+}
+
+uint32_t Bitset::findNext(uint32_t from) const {
+  if (from >= bits) {
+    return bits;
+  }
+
+  uint32_t i = from / WORD_BITS;
+  uint32_t w = data[i] & (~0u << (from % WORD_BITS));
+  while (w == 0) {
+    if (++i >= wordCount()) {
+      return bits;
+    }
+    w = data[i];
+  }
+  return i * WORD_BITS + __builtin_ctz(w);
+}
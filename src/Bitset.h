@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed-size bitset kept in 32-bit words, so counting and combining work a
+// word at a time with the builtin popcount/ctz. Bit i is bit i % 32 of word
+// i / 32, which on little-endian targets (the ESP32 and hosts) gives the
+// same byte layout as the LSB-first .bit files; bytes() reads and writes
+// that image directly. Bits past size() are always zero.
+class Bitset {
+ public:
+  static constexpr uint32_t WORD_BITS = 32;
+
+  // Resize to bitCount bits, all clear
+  void resize(uint32_t bitCount);
+  // Drop all bits and free the storage
+  void reset();
+
+  bool empty() const { return bits == 0; }
+  uint32_t size() const { return bits; }
+  uint32_t wordCount() const { return static_cast<uint32_t>(data.size()); }
+  uint32_t word(uint32_t i) const { return data[i]; }
+
+  bool test(uint32_t i) const { return i < bits && ((data[i / WORD_BITS] >> (i % WORD_BITS)) & 1); }
+  void set(uint32_t i) {
+    if (i < bits) data[i / WORD_BITS] |= 1u << (i % WORD_BITS);
+  }
+  void clear(uint32_t i) {
+    if (i < bits) data[i / WORD_BITS] &= ~(1u << (i % WORD_BITS));
+  }
+  // Set count bits starting at from (clipped to size())
+  void setRange(uint32_t from, uint32_t count);
+  void clearAll();
+
+  // File image: the first byteSize() bytes. Call trim() after writing
+  // through bytes(), in case the file had bits set past size().
+  uint8_t* bytes() { return reinterpret_cast<uint8_t*>(data.data()); }
+  const uint8_t* bytes() const { return reinterpret_cast<const uint8_t*>(data.data()); }
+  size_t byteSize() const { return (bits + 7) / 8; }
+  void trim();
+
+  uint32_t count() const;
+  // Bits set here and clear in other, whose word otherWord lines up with
+  // word 0 here (so one chunk can be compared with a slice of a larger
+  // bitset). Words past the end of other count as clear.
+  uint32_t countAndNot(const Bitset& other, uint32_t otherWord = 0) const;
+
+  void andNot(const Bitset& other, uint32_t otherWord = 0);
+  void intersect(const Bitset& other);
+  void unite(const Bitset& other);
+
+  // First set bit at or after from, or size() if there is none
+  uint32_t findNext(uint32_t from) const;
+
+ private:
+  std::vector<uint32_t> data;
+  uint32_t bits = 0;
+};
@@ -0,0 +1,102 @@
+#include "BitsetIndex.h"
+
+void BitsetIndex::build(const Bitset* includeBits, const Bitset* excludeBits, uint32_t bitCount) {
+  include = includeBits;
+  exclude = excludeBits;
+  bits = bitCount;
+  words = (bitCount + Bitset::WORD_BITS - 1) / Bitset::WORD_BITS;
+  total = 0;
+
+  blockStart.assign((bitCount + BLOCK_BITS - 1) / BLOCK_BITS, 0);
+  for (uint32_t i = 0; i < words; i++) {
+    if (i % BLOCK_WORDS == 0) {
+      blockStart[i / BLOCK_WORDS] = total;
+    }
+    total += __builtin_popcount(wordAt(i));
+  }
+}
+
+void BitsetIndex::clear() {
+  include = nullptr;
+  exclude = nullptr;
+  bits = 0;
+  words = 0;
+  total = 0;
+  blockStart.clear();
+}
+
+uint32_t BitsetIndex::wordAt(uint32_t i) const {
+  uint32_t w = include ? include->word(i) : ~0u;
+  if (exclude) {
+    w &= ~exclude->word(i);
+  }
+  // Ignore bits past the end
+  if (i == words - 1 && bits % Bitset::WORD_BITS) {
+    w &= (1u << (bits % Bitset::WORD_BITS)) - 1;
+  }
+  return w;
+}
+
+bool BitsetIndex::contains(uint32_t index) const {
+  if (index >= bits) {
+    return false;
+  }
+  return (wordAt(index / Bitset::WORD_BITS) >> (index % Bitset::WORD_BITS)) & 1;
+}
+
+uint32_t BitsetIndex::rank(uint32_t index) const {
+  if (index >= bits) {
+    return total;
+  }
+
+  const uint32_t word = index / Bitset::WORD_BITS;
+  uint32_t result = blockStart[index / BLOCK_BITS];
+  for (uint32_t i = word - word % BLOCK_WORDS; i < word; i++) {
+    result += __builtin_popcount(wordAt(i));
+  }
+  const uint32_t below = (1u << (index % Bitset::WORD_BITS)) - 1;
+  return result + __builtin_popcount(wordAt(word) & below);
+}
+
+bool BitsetIndex::select(uint32_t k, uint32_t& index) const {
+  if (k >= total) {
+    return false;
+  }
+
+  // Last block starting at or before k
+  uint32_t lo = 0;
+  uint32_t hi = static_cast<uint32_t>(blockStart.size()) - 1;
+  while (lo < hi) {
+    const uint32_t mid = (lo + hi + 1) / 2;
+    if (blockStart[mid] <= k) {
+      lo = mid;
+    } else {
+      hi = mid - 1;
+    }
+  }
+
+  uint32_t remaining = k - blockStart[lo];
+  for (uint32_t i = lo * BLOCK_WORDS; i < words; i++) {
+    uint32_t w = wordAt(i);
+    const uint32_t ones = __builtin_popcount(w);
+    if (remaining < ones) {
+      while (remaining-- > 0) {
+        w &= w - 1;
+      }
+      index = i * Bitset::WORD_BITS + __builtin_ctz(w);
+      return true;
+    }
+    remaining -= ones;
+  }
+  return false;
+}
+
+void BitsetIndex::remove(uint32_t index) {
+  if (index >= bits || total == 0) {
+    return;
+  }
+  for (uint32_t block = index / BLOCK_BITS + 1; block < blockStart.size(); block++) {
+    blockStart[block]--;
+  }
+  total--;
+}
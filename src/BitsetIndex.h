@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Bitset.h"
+
+// Rank/select over the puzzles selected by two bitsets: those set in
+// `include` and clear in `exclude` (e.g. a theme's puzzles that are not
+// solved yet). A running count at the start of every BLOCK_BITS block makes
+// rank() one lookup plus a partial block scan and select() a binary search
+// plus one block scan, instead of a pass over the whole pack. Scans go a
+// word at a time.
+//
+// The bitsets are not copied: they must outlive the index and must not be
+// resized. After setting a bit in `exclude` or clearing one in `include`,
+// call remove() so the counts stay correct.
+class BitsetIndex {
+ public:
+  static constexpr uint32_t BLOCK_BITS = 2048;
+  static constexpr uint32_t BLOCK_WORDS = BLOCK_BITS / Bitset::WORD_BITS;
+
+  // include == nullptr selects every index below bitCount; exclude ==
+  // nullptr excludes none. Each bitset holds at least bitCount bits.
+  void build(const Bitset* include, const Bitset* exclude, uint32_t bitCount);
+  void clear();
+
+  bool empty() const { return total == 0; }
+  uint32_t count() const { return total; }
+  bool contains(uint32_t index) const;
+
+  // Number of selected indices below index
+  uint32_t rank(uint32_t index) const;
+
+  // The k-th selected index (k from 0); false if k >= count()
+  bool select(uint32_t k, uint32_t& index) const;
+
+  // Index is no longer selected (set in exclude or cleared in include);
+  // it must have been selected before
+  void remove(uint32_t index);
+
+ private:
+  const Bitset* include = nullptr;
+  const Bitset* exclude = nullptr;
+  uint32_t bits = 0;
+  uint32_t words = 0;
+  uint32_t total = 0;
+  std::vector<uint32_t> blockStart;  // Selected indices before each block
+
+  uint32_t wordAt(uint32_t i) const;
+};
@@ -5,19 +5,222 @@
 namespace Chess {
 
 namespace {
-    const int KNIGHT_OFFSETS[] = {-17, -15, -10, -6, 6, 10, 15, 17};
-    const int KING_OFFSETS[] = {-9, -8, -7, -1, 1, 7, 8, 9};
-    const int BISHOP_DIRS[] = {-9, -7, 7, 9};
-    const int ROOK_DIRS[] = {-8, -1, 1, 8};
-    const int QUEEN_DIRS[] = {-9, -8, -7, -1, 1, 7, 8, 9};
+    constexpr Bitboard FILE_A = 0x0101010101010101ULL;
+    constexpr Bitboard FILE_H = FILE_A << 7;
+    constexpr Bitboard RANK_1 = 0xFFULL;
+    constexpr Bitboard RANK_3 = RANK_1 << 16;
+    constexpr Bitboard RANK_6 = RANK_1 << 40;
+    constexpr Bitboard RANK_8 = RANK_1 << 56;
 
-    std::string readRecordField(const uint8_t* data, size_t offset, size_t maxLen) {
+    // Shift every square in the set one step in a direction (square offset),
+    // dropping squares that would wrap around the a- or h-file.
+    Bitboard step(Bitboard b, int dir) {
+        switch (dir) {
+            case 8: return b << 8;
+            case -8: return b >> 8;
+            case 9: return (b & ~FILE_H) << 9;
+            case 7: return (b & ~FILE_A) << 7;
+            case -7: return (b & ~FILE_H) >> 7;
+            case -9: return (b & ~FILE_A) >> 9;
+        }
+        return 0;
+    }
+
+    // ------------------------------------------------------------------------
+    // Attack tables, generated at compile time and kept in flash (.rodata).
+    // Sliders use per-direction rays: the first blocker on a ray is found with
+    // a bit scan and the ray beyond it is masked off, so lookups never test
+    // board edges. The whole set is ~6.5 KB; magic tables would need ~800 KB.
+    // ------------------------------------------------------------------------
+
+    // Ray directions as (file, rank) steps. The first four point towards
+    // higher square numbers, the last four towards lower ones.
+    enum Direction { NORTH, EAST, NORTH_EAST, NORTH_WEST, SOUTH, WEST, SOUTH_WEST, SOUTH_EAST };
+    constexpr int DIR_STEPS[8][2] = {{0, 1}, {1, 0}, {1, 1}, {-1, 1}, {0, -1}, {-1, 0}, {-1, -1}, {1, -1}};
+    constexpr int KNIGHT_STEPS[8][2] = {{1, 2}, {2, 1}, {2, -1}, {1, -2}, {-1, -2}, {-2, -1}, {-2, 1}, {-1, 2}};
+
+    struct SquareTable {
+        Bitboard bb[64];
+    };
+
+    struct RayTable {
+        Bitboard bb[8][64];
+    };
+
+    // Squares reached from sq by repeating (df, dr) up to `limit` times
+    constexpr Bitboard stepMask(int sq, int df, int dr, int limit) {
+        Bitboard mask = 0;
+        int f = sq & 7;
+        int r = sq >> 3;
+        for (int i = 0; i < limit; i++) {
+            f += df;
+            r += dr;
+            if (f < 0 || f > 7 || r < 0 || r > 7) break;
+            mask |= squareBB(r * 8 + f);
+        }
+        return mask;
+    }
+
+    constexpr SquareTable makeLeaperTable(const int (&steps)[8][2]) {
+        SquareTable table = {};
+        for (int sq = 0; sq < 64; sq++) {
+            for (int i = 0; i < 8; i++) {
+                table.bb[sq] |= stepMask(sq, steps[i][0], steps[i][1], 1);
+            }
+        }
+        return table;
+    }
+
+    constexpr SquareTable makePawnTable(int dr) {
+        SquareTable table = {};
+        for (int sq = 0; sq < 64; sq++) {
+            table.bb[sq] = stepMask(sq, -1, dr, 1) | stepMask(sq, 1, dr, 1);
+        }
+        return table;
+    }
+
+    constexpr RayTable makeRayTable() {
+        RayTable table = {};
+        for (int dir = 0; dir < 8; dir++) {
+            for (int sq = 0; sq < 64; sq++) {
+                table.bb[dir][sq] = stepMask(sq, DIR_STEPS[dir][0], DIR_STEPS[dir][1], 7);
+            }
+        }
+        return table;
+    }
+
+    constexpr SquareTable KNIGHT_ATTACKS = makeLeaperTable(KNIGHT_STEPS);
+    constexpr SquareTable KING_ATTACKS = makeLeaperTable(DIR_STEPS);
+    constexpr SquareTable PAWN_ATTACKS[2] = {makePawnTable(1), makePawnTable(-1)};
+    constexpr RayTable RAYS = makeRayTable();
+
+    static_assert(KNIGHT_ATTACKS.bb[0] == 0x20400ULL, "knight table");
+    static_assert(KING_ATTACKS.bb[63] == 0x40C0000000000000ULL, "king table");
+    static_assert(RAYS.bb[NORTH_EAST][0] == 0x8040201008040200ULL, "ray table");
+
+    // ------------------------------------------------------------------------
+    // Zobrist keys, also generated at compile time (splitmix64 sequence with a
+    // fixed seed, so keys are stable across builds and devices).
+    // ------------------------------------------------------------------------
+
+    struct ZobristTable {
+        uint64_t piece[13][64];  // Indexed by Piece; row 0 (NONE) stays zero
+        uint64_t castling[16];   // Indexed by the castling bit set
+        uint64_t epFile[8];
+        uint64_t blackToMove;
+    };
+
+    constexpr uint64_t splitmix64(uint64_t& state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    constexpr ZobristTable makeZobristTable() {
+        ZobristTable table = {};
+        uint64_t state = 0x43505A31ULL;  // "CPZ1"
+        for (int p = W_PAWN; p <= B_KING; p++) {
+            for (int sq = 0; sq < 64; sq++) {
+                table.piece[p][sq] = splitmix64(state);
+            }
+        }
+        // One key per right; combinations are the XOR of their bits so that
+        // clearing a right is a single table lookup either way.
+        uint64_t rights[4] = {};
+        for (int i = 0; i < 4; i++) {
+            rights[i] = splitmix64(state);
+        }
+        for (int mask = 0; mask < 16; mask++) {
+            for (int i = 0; i < 4; i++) {
+                if (mask & (1 << i)) table.castling[mask] ^= rights[i];
+            }
+        }
+        for (int f = 0; f < 8; f++) {
+            table.epFile[f] = splitmix64(state);
+        }
+        table.blackToMove = splitmix64(state);
+        return table;
+    }
+
+    constexpr ZobristTable ZOBRIST = makeZobristTable();
+
+    static_assert(ZOBRIST.piece[NONE][0] == 0, "empty squares hash to zero");
+    static_assert(ZOBRIST.castling[15] == (ZOBRIST.castling[1] ^ ZOBRIST.castling[2] ^
+                                           ZOBRIST.castling[4] ^ ZOBRIST.castling[8]), "castling keys");
+
+    Bitboard knightAttacks(int sq) { return KNIGHT_ATTACKS.bb[sq]; }
+    Bitboard kingAttacks(int sq) { return KING_ATTACKS.bb[sq]; }
+
+    // Squares attacked by a pawn of the given color standing on sq
+    Bitboard pawnAttacks(bool white, int sq) { return PAWN_ATTACKS[colorIndex(white)].bb[sq]; }
+
+    // The sentinel bit (h8 / a1) stands in for "no blocker": the ray from the
+    // last square in a direction is empty, so the XOR leaves the full ray.
+    Bitboard positiveRay(int dir, int sq, Bitboard occ) {
+        Bitboard ray = RAYS.bb[dir][sq];
+        return ray ^ RAYS.bb[dir][lsb((ray & occ) | squareBB(63))];
+    }
+
+    Bitboard negativeRay(int dir, int sq, Bitboard occ) {
+        Bitboard ray = RAYS.bb[dir][sq];
+        return ray ^ RAYS.bb[dir][msb((ray & occ) | squareBB(0))];
+    }
+
+    Bitboard bishopAttacks(int sq, Bitboard occ) {
+        return positiveRay(NORTH_EAST, sq, occ) | positiveRay(NORTH_WEST, sq, occ) |
+               negativeRay(SOUTH_WEST, sq, occ) | negativeRay(SOUTH_EAST, sq, occ);
+    }
+
+    Bitboard rookAttacks(int sq, Bitboard occ) {
+        return positiveRay(NORTH, sq, occ) | positiveRay(EAST, sq, occ) |
+               negativeRay(SOUTH, sq, occ) | negativeRay(WEST, sq, occ);
+    }
+
+    // Emit from -> each target, flagging those that land on an enemy piece
+    void addMoves(int from, Bitboard targets, Bitboard enemies, MoveList& moves) {
+        while (targets) {
+            int to = popLsb(targets);
+            moves.push(Move(from, to, 0, (squareBB(to) & enemies) ? Move::CAPTURE : 0));
+        }
+    }
+
+    // Emit pawn moves landing on targets, each coming from (to - offset)
+    void addPawnMoves(Bitboard targets, int offset, Bitboard promoRank, int flags, MoveList& moves) {
+        while (targets) {
+            int to = popLsb(targets);
+            int from = to - offset;
+            if (squareBB(to) & promoRank) {
+                moves.push(Move(from, to, 4, flags));
+                moves.push(Move(from, to, 3, flags));
+                moves.push(Move(from, to, 2, flags));
+                moves.push(Move(from, to, 1, flags));
+            } else {
+                moves.push(Move(from, to, 0, flags));
+            }
+        }
+    }
+
+    // CPZ record layout (see tools/pack_lichess_cpz.py)
+    constexpr int RECORD_BOARD_OFFSET = 4;
+    constexpr int RECORD_MOVES_OFFSET = 36;
+    constexpr int RECORD_THEMES_OFFSET = 84;       // CPZ1 text, replaced by internRecord()
+    constexpr int RECORD_OPENING_OFFSET = 116;
+    constexpr int RECORD_THEME_MASK_OFFSET = 84;   // Interned: LE u64 theme mask
+    constexpr int RECORD_OPENING_ID_OFFSET = 92;   // Interned: LE u16 opening id
+
+    uint32_t readLE32(const uint8_t* p) {
+        return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+    }
+
+    // NUL-padded text field of at most maxLen bytes
+    std::string_view recordField(const uint8_t* data, size_t offset, size_t maxLen) {
         const char* start = reinterpret_cast<const char*>(data + offset);
         size_t len = 0;
         while (len < maxLen && start[len] != '\0') {
             ++len;
         }
-        return std::string(start, len);
+        return std::string_view(start, len);
     }
 }
 
@@ -28,88 +231,79 @@ BoardState::BoardState() {
     epSquare = -1;
     halfmoveClock = 0;
     fullmoveNum = 1;
+    rebuildDerivedState();
 }
 
-int BoardState::findKing(bool white) const {
-    Piece target = white ? W_KING : B_KING;
-    for (int sq = 0; sq < 64; sq++) {
-        if (board[sq] == target) return sq;
+void BoardState::putPiece(int sq, Piece p) {
+    const Bitboard bit = squareBB(sq);
+    const int color = colorIndex(isWhite(p));
+    board[sq] = p;
+    key ^= ZOBRIST.piece[p][sq];
+    typeBB[pieceType(p)] |= bit;
+    colorBB[color] |= bit;
+    typeBB[0] |= bit;
+    pieceCount[p]++;
+    material[color] += PIECE_VALUES[pieceType(p)];
+    if (pieceType(p) == KING) kingSq[color] = sq;
+}
+
+void BoardState::removePiece(int sq) {
+    const Bitboard bit = squareBB(sq);
+    const Piece p = board[sq];
+    const int color = colorIndex(isWhite(p));
+    board[sq] = NONE;
+    key ^= ZOBRIST.piece[p][sq];
+    typeBB[pieceType(p)] &= ~bit;
+    colorBB[color] &= ~bit;
+    typeBB[0] &= ~bit;
+    pieceCount[p]--;
+    material[color] -= PIECE_VALUES[pieceType(p)];
+    if (kingSq[color] == sq) {
+        // Only reachable with extra kings on the board (setup positions)
+        Bitboard kings = typeBB[KING] & colorBB[color];
+        kingSq[color] = kings ? lsb(kings) : -1;
     }
-    return -1;
 }
 
-bool BoardState::isAttacked(int sq, bool byWhite) const {
-    int file = fileOf(sq);
-    int rank = rankOf(sq);
-    
-    Piece enemyPawn = byWhite ? W_PAWN : B_PAWN;
-    Piece enemyKnight = byWhite ? W_KNIGHT : B_KNIGHT;
-    Piece enemyBishop = byWhite ? W_BISHOP : B_BISHOP;
-    Piece enemyRook = byWhite ? W_ROOK : B_ROOK;
-    Piece enemyQueen = byWhite ? W_QUEEN : B_QUEEN;
-    Piece enemyKing = byWhite ? W_KING : B_KING;
-    
-    int pawnDir = byWhite ? -1 : 1;
-    int pawnRank = rank + pawnDir;
-    if (pawnRank >= 0 && pawnRank < 8) {
-        if (file > 0) {
-            int pawnSq = makeSquare(file - 1, pawnRank);
-            if (board[pawnSq] == enemyPawn) return true;
-        }
-        if (file < 7) {
-            int pawnSq = makeSquare(file + 1, pawnRank);
-            if (board[pawnSq] == enemyPawn) return true;
-        }
+void BoardState::set(int sq, Piece p) {
+    if (board[sq] != NONE) removePiece(sq);
+    if (p != NONE) putPiece(sq, p);
+}
+
+void BoardState::rebuildDerivedState() {
+    memset(typeBB, 0, sizeof(typeBB));
+    memset(colorBB, 0, sizeof(colorBB));
+    memset(pieceCount, 0, sizeof(pieceCount));
+    kingSq[0] = kingSq[1] = -1;
+    material[0] = material[1] = 0;
+    key = 0;
+    for (int sq = 0; sq < 64; sq++) {
+        if (board[sq] != NONE) putPiece(sq, board[sq]);
     }
-    
-    for (int offset : KNIGHT_OFFSETS) {
-        int target = sq + offset;
-        if (!isValidSquare(target)) continue;
-        int tf = fileOf(target);
-        int fileDiff = abs(file - tf);
-        if (fileDiff > 2) continue;
-        if (board[target] == enemyKnight) return true;
-    }
-    
-    for (int offset : KING_OFFSETS) {
-        int target = sq + offset;
-        if (!isValidSquare(target)) continue;
-        int tf = fileOf(target);
-        int fileDiff = abs(file - tf);
-        if (fileDiff > 1) continue;
-        if (board[target] == enemyKing) return true;
-    }
-    
-    for (int dir : BISHOP_DIRS) {
-        int current = sq;
-        while (true) {
-            int prevFile = fileOf(current);
-            current += dir;
-            if (!isValidSquare(current)) break;
-            int newFile = fileOf(current);
-            if (abs(newFile - prevFile) != 1) break;
-            
-            Piece p = board[current];
-            if (p == enemyBishop || p == enemyQueen) return true;
-            if (p != NONE) break;
-        }
+    key ^= stateKey();
+}
+
+uint64_t BoardState::stateKey() const {
+    uint64_t k = ZOBRIST.castling[castling & 0x0F];
+    if (!whiteToMove) k ^= ZOBRIST.blackToMove;
+    // Only hash the ep file when a capture is actually possible, so positions
+    // that differ just by an unusable ep square share a key.
+    if (epSquare >= 0 && (pawnAttacks(!whiteToMove, epSquare) & pieces(PAWN, whiteToMove))) {
+        k ^= ZOBRIST.epFile[fileOf(epSquare)];
     }
+    return k;
+}
+
+bool BoardState::isAttacked(int sq, bool byWhite) const {
+    const Bitboard occ = occupied();
+    const Bitboard them = pieces(byWhite);
     
-    for (int dir : ROOK_DIRS) {
-        int current = sq;
-        while (true) {
-            int prevFile = fileOf(current);
-            current += dir;
-            if (!isValidSquare(current)) break;
-            int newFile = fileOf(current);
-            if (abs(dir) == 1 && newFile != prevFile + dir) break;
-            if (abs(dir) == 8 && newFile != prevFile) break;
-            
-            Piece p = board[current];
-            if (p == enemyRook || p == enemyQueen) return true;
-            if (p != NONE) break;
-        }
-    }
+    // A pawn of ours on sq would attack exactly the squares enemy pawns attack sq from
+    if (pawnAttacks(!byWhite, sq) & typeBB[PAWN] & them) return true;
+    if (knightAttacks(sq) & typeBB[KNIGHT] & them) return true;
+    if (kingAttacks(sq) & typeBB[KING] & them) return true;
+    if (bishopAttacks(sq, occ) & (typeBB[BISHOP] | typeBB[QUEEN]) & them) return true;
+    if (rookAttacks(sq, occ) & (typeBB[ROOK] | typeBB[QUEEN]) & them) return true;
     
     return false;
 }
@@ -120,318 +314,502 @@ bool BoardState::inCheck() const {
     return isAttacked(kingSq, !whiteToMove);
 }
 
-void BoardState::generatePawnMoves(int sq, std::vector<Move>& moves) const {
-    int file = fileOf(sq);
-    int rank = rankOf(sq);
-    bool isWhite = Chess::isWhite(board[sq]);
-    int dir = isWhite ? 1 : -1;
-    int startRank = isWhite ? 1 : 6;
-    int promoRank = isWhite ? 7 : 0;
-    
-    int forward = sq + dir * 8;
-    if (isValidSquare(forward) && board[forward] == NONE) {
-        if (rankOf(forward) == promoRank) {
-            moves.push_back(Move(sq, forward, 4));
-            moves.push_back(Move(sq, forward, 3));
-            moves.push_back(Move(sq, forward, 2));
-            moves.push_back(Move(sq, forward, 1));
-        } else {
-            moves.push_back(Move(sq, forward, 0));
-            
-            if (rank == startRank) {
-                int doubleForward = sq + dir * 16;
-                if (board[doubleForward] == NONE) {
-                    moves.push_back(Move(sq, doubleForward, 0));
-                }
-            }
-        }
+Bitboard BoardState::attackersTo(int sq, Bitboard occ) const {
+    return (pawnAttacks(false, sq) & pieces(PAWN, true)) |
+           (pawnAttacks(true, sq) & pieces(PAWN, false)) |
+           (knightAttacks(sq) & typeBB[KNIGHT]) |
+           (kingAttacks(sq) & typeBB[KING]) |
+           (bishopAttacks(sq, occ) & (typeBB[BISHOP] | typeBB[QUEEN])) |
+           (rookAttacks(sq, occ) & (typeBB[ROOK] | typeBB[QUEEN]));
+}
+
+int BoardState::see(const Move& move) const {
+    // Kings only ever recapture last, so any large value works for them
+    static constexpr int SEE_VALUES[7] = {0, 100, 320, 330, 500, 900, 20000};
+    
+    const int to = move.to();
+    const Piece moving = board[move.from()];
+    if (moving == NONE) return 0;
+    
+    Bitboard occ = occupied() ^ squareBB(move.from());
+    int gain[32];
+    gain[0] = SEE_VALUES[pieceType(board[to])];
+    if (pieceType(moving) == PAWN && to == epSquare) {
+        gain[0] = SEE_VALUES[PAWN];
+        occ ^= squareBB(isWhite(moving) ? to - 8 : to + 8);
+    }
+    
+    // Value of the piece standing on `to`, i.e. what the next capture wins
+    int onSquare = SEE_VALUES[pieceType(moving)];
+    if (move.promo() > 0) {
+        onSquare = SEE_VALUES[move.promo() + 1];
+        gain[0] += onSquare - SEE_VALUES[PAWN];
     }
     
-    int captureLeft = sq + dir * 8 - 1;
-    int captureRight = sq + dir * 8 + 1;
+    const Bitboard diagonal = typeBB[BISHOP] | typeBB[QUEEN];
+    const Bitboard straight = typeBB[ROOK] | typeBB[QUEEN];
+    Bitboard attackers = attackersTo(to, occ) & occ;
+    bool white = !isWhite(moving);
+    int depth = 0;
     
-    if (file > 0 && isValidSquare(captureLeft)) {
-        Piece target = board[captureLeft];
-        bool canCapture = (target != NONE && isWhite != Chess::isWhite(target));
-        if (!canCapture && captureLeft == epSquare) canCapture = true;
+    while (depth < 31) {
+        const Bitboard ours = attackers & pieces(white);
+        if (!ours) break;
         
-        if (canCapture) {
-            if (rankOf(captureLeft) == promoRank) {
-                moves.push_back(Move(sq, captureLeft, 4));
-                moves.push_back(Move(sq, captureLeft, 3));
-                moves.push_back(Move(sq, captureLeft, 2));
-                moves.push_back(Move(sq, captureLeft, 1));
-            } else {
-                moves.push_back(Move(sq, captureLeft, 0));
-            }
-        }
+        int type = PAWN;
+        while (!(ours & typeBB[type])) type++;
+        
+        // The king cannot recapture into a defended square
+        if (type == KING && (attackers & pieces(!white))) break;
+        
+        depth++;
+        gain[depth] = onSquare - gain[depth - 1];
+        onSquare = SEE_VALUES[type];
+        
+        const Bitboard bb = ours & typeBB[type];
+        occ ^= bb & (~bb + 1);
+        
+        // Removing the capturer may uncover a slider behind it
+        if (type == PAWN || type == BISHOP || type == QUEEN) attackers |= bishopAttacks(to, occ) & diagonal;
+        if (type == ROOK || type == QUEEN) attackers |= rookAttacks(to, occ) & straight;
+        attackers &= occ;
+        white = !white;
     }
     
-    if (file < 7 && isValidSquare(captureRight)) {
-        Piece target = board[captureRight];
-        bool canCapture = (target != NONE && isWhite != Chess::isWhite(target));
-        if (!canCapture && captureRight == epSquare) canCapture = true;
-        
-        if (canCapture) {
-            if (rankOf(captureRight) == promoRank) {
-                moves.push_back(Move(sq, captureRight, 4));
-                moves.push_back(Move(sq, captureRight, 3));
-                moves.push_back(Move(sq, captureRight, 2));
-                moves.push_back(Move(sq, captureRight, 1));
-            } else {
-                moves.push_back(Move(sq, captureRight, 0));
-            }
-        }
+    // Each side picks the better of capturing or standing pat, from the back
+    while (depth > 0) {
+        gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+        depth--;
     }
+    return gain[0];
 }
 
-void BoardState::generateKnightMoves(int sq, std::vector<Move>& moves) const {
-    int file = fileOf(sq);
-    bool isWhite = Chess::isWhite(board[sq]);
+void BoardState::generatePawnMoves(Bitboard pawns, Bitboard allowed, MoveList& moves) const {
+    const bool white = whiteToMove;
+    const int up = white ? 8 : -8;
+    const Bitboard empty = ~occupied();
+    const Bitboard promoRank = white ? RANK_8 : RANK_1;
+    const Bitboard doubleRank = white ? RANK_3 : RANK_6;
+    const Bitboard targets = pieces(!white) & allowed;
     
-    for (int offset : KNIGHT_OFFSETS) {
-        int target = sq + offset;
-        if (!isValidSquare(target)) continue;
-        int tf = fileOf(target);
-        int fileDiff = abs(file - tf);
-        if (fileDiff > 2) continue;
-        
-        Piece p = board[target];
-        if (p == NONE || (isWhite != Chess::isWhite(p))) {
-            moves.push_back(Move(sq, target, 0));
-        }
-    }
+    Bitboard single = step(pawns, up) & empty;
+    Bitboard doubles = step(single & doubleRank, up) & empty & allowed;
+    Bitboard captureLeft = step(pawns, up - 1) & targets;
+    Bitboard captureRight = step(pawns, up + 1) & targets;
+    
+    addPawnMoves(single & allowed, up, promoRank, 0, moves);
+    addPawnMoves(doubles, up * 2, 0, Move::DOUBLE_PUSH, moves);
+    addPawnMoves(captureLeft, up - 1, promoRank, Move::CAPTURE, moves);
+    addPawnMoves(captureRight, up + 1, promoRank, Move::CAPTURE, moves);
 }
 
-void BoardState::generateSlidingMoves(int sq, const int* directions, int numDirs,
-                                       std::vector<Move>& moves) const {
-    int file = fileOf(sq);
-    bool isWhite = Chess::isWhite(board[sq]);
+void BoardState::generateEnPassant(Bitboard pawns, int kingSq, MoveList& moves) const {
+    if (epSquare < 0) return;
     
-    for (int i = 0; i < numDirs; i++) {
-        int dir = directions[i];
-        int current = sq;
-        
-        while (true) {
-            int prevFile = fileOf(current);
-            current += dir;
-            if (!isValidSquare(current)) break;
-            int newFile = fileOf(current);
-            
-            if (abs(dir) == 1) {
-                if (newFile != prevFile + dir) break;
-            } else if (abs(dir) == 7 || abs(dir) == 9) {
-                if (abs(newFile - prevFile) != 1) break;
-            }
-            
-            Piece p = board[current];
-            if (p == NONE) {
-                moves.push_back(Move(sq, current, 0));
-            } else {
-                if (isWhite != Chess::isWhite(p)) {
-                    moves.push_back(Move(sq, current, 0));
-                }
-                break;
-            }
+    const bool white = whiteToMove;
+    const int capturedSq = white ? epSquare - 8 : epSquare + 8;
+    const Bitboard captured = squareBB(capturedSq);
+    const Bitboard them = pieces(!white) & ~captured;
+    
+    // Two pawns leave the same rank at once, which can expose the king along
+    // it, so test the position after the capture directly.
+    Bitboard attackers = pawnAttacks(!white, epSquare) & pawns;
+    while (attackers) {
+        int from = popLsb(attackers);
+        Bitboard occ = (occupied() ^ squareBB(from) ^ captured) | squareBB(epSquare);
+        if (!(attackersTo(kingSq, occ) & them)) {
+            moves.push(Move(from, epSquare, 0, Move::CAPTURE | Move::EN_PASSANT));
         }
     }
 }
 
-void BoardState::generateKingMoves(int sq, std::vector<Move>& moves) const {
-    int file = fileOf(sq);
-    bool isWhite = Chess::isWhite(board[sq]);
+bool BoardState::canCastle(bool kingSide) const {
+    const bool white = whiteToMove;
+    const int kingFrom = white ? 4 : 60;
+    const int rookFrom = kingFrom + (kingSide ? 3 : -4);
+    const uint8_t right = kingSide ? (white ? 1 : 4) : (white ? 2 : 8);
+    // Squares between king and rook, and the two the king crosses
+    const Bitboard between = (kingSide ? 0x60ULL : 0x0EULL) << (white ? 0 : 56);
+    const int step = kingSide ? 1 : -1;
+    
+    if (!(castling & right)) return false;
+    if (board[kingFrom] != makePiece(KING, white) || board[rookFrom] != makePiece(ROOK, white)) return false;
+    if (occupied() & between) return false;
+    
+    // The king may not pass through or land on an attacked square
+    return !isAttacked(kingFrom + step, !white) && !isAttacked(kingFrom + 2 * step, !white);
+}
+
+void BoardState::generateCastling(MoveList& moves) const {
+    const int kingFrom = whiteToMove ? 4 : 60;
+    if (canCastle(true)) moves.push(Move(kingFrom, kingFrom + 2, 0, Move::CASTLE));
+    if (canCastle(false)) moves.push(Move(kingFrom, kingFrom - 2, 0, Move::CASTLE));
+}
+
+void BoardState::generateLegal(Bitboard fromMask, MoveList& moves, bool stopAtFirst) const {
+    const bool white = whiteToMove;
+    const int kingSq = findKing(white);
+    if (kingSq < 0) return;
     
-    for (int offset : KING_OFFSETS) {
-        int target = sq + offset;
-        if (!isValidSquare(target)) continue;
-        int tf = fileOf(target);
-        int fileDiff = abs(file - tf);
-        if (fileDiff > 1) continue;
+    const Bitboard us = pieces(white);
+    const Bitboard them = pieces(!white);
+    const Bitboard occ = occupied();
+    fromMask &= us;
+    
+    // Checkers and pins, found by walking the eight rays out of the king.
+    // checkMask holds the squares that block or capture a single checker;
+    // pinRays[dir] holds the line a piece pinned along dir may still use.
+    Bitboard checkers = ((knightAttacks(kingSq) & typeBB[KNIGHT]) |
+                         (pawnAttacks(white, kingSq) & typeBB[PAWN])) & them;
+    Bitboard checkMask = checkers;
+    Bitboard pinned = 0;
+    Bitboard pinRays[8] = {};
+    
+    const Bitboard diagonalSliders = (typeBB[BISHOP] | typeBB[QUEEN]) & them;
+    const Bitboard straightSliders = (typeBB[ROOK] | typeBB[QUEEN]) & them;
+    for (int dir = 0; dir < 8; dir++) {
+        const bool diagonal = dir == NORTH_EAST || dir == NORTH_WEST || dir == SOUTH_WEST || dir == SOUTH_EAST;
+        const Bitboard sliders = diagonal ? diagonalSliders : straightSliders;
+        const Bitboard ray = RAYS.bb[dir][kingSq];
+        if (!(ray & sliders)) continue;
+        
+        const bool positive = dir < SOUTH;
+        Bitboard blockers = ray & occ;
+        int first = positive ? lsb(blockers) : msb(blockers);
+        if (squareBB(first) & sliders) {
+            checkers |= squareBB(first);
+            checkMask |= ray ^ RAYS.bb[dir][first];
+            continue;
+        }
+        if (!(squareBB(first) & us)) continue;
         
-        Piece p = board[target];
-        if (p == NONE || (isWhite != Chess::isWhite(p))) {
-            moves.push_back(Move(sq, target, 0));
+        blockers &= RAYS.bb[dir][first];
+        if (!blockers) continue;
+        int second = positive ? lsb(blockers) : msb(blockers);
+        if (squareBB(second) & sliders) {
+            pinned |= squareBB(first);
+            pinRays[dir] = ray ^ RAYS.bb[dir][second];
         }
     }
     
-    if (isWhite && sq == 4) {
-        if ((castling & 1) && board[5] == NONE && board[6] == NONE && board[7] == W_ROOK) {
-            if (!isAttacked(4, false) && !isAttacked(5, false) && !isAttacked(6, false)) {
-                moves.push_back(Move(4, 6, 0));
-            }
-        }
-        if ((castling & 2) && board[3] == NONE && board[2] == NONE && board[1] == NONE && board[0] == W_ROOK) {
-            if (!isAttacked(4, false) && !isAttacked(3, false) && !isAttacked(2, false)) {
-                moves.push_back(Move(4, 2, 0));
-            }
-        }
-    } else if (!isWhite && sq == 60) {
-        if ((castling & 4) && board[61] == NONE && board[62] == NONE && board[63] == B_ROOK) {
-            if (!isAttacked(60, true) && !isAttacked(61, true) && !isAttacked(62, true)) {
-                moves.push_back(Move(60, 62, 0));
-            }
-        }
-        if ((castling & 8) && board[59] == NONE && board[58] == NONE && board[57] == NONE && board[56] == B_ROOK) {
-            if (!isAttacked(60, true) && !isAttacked(59, true) && !isAttacked(58, true)) {
-                moves.push_back(Move(60, 58, 0));
+    if (fromMask & squareBB(kingSq)) {
+        // Lift the king off the board so it cannot hide behind itself
+        const Bitboard occWithoutKing = occ ^ squareBB(kingSq);
+        Bitboard targets = kingAttacks(kingSq) & ~us;
+        while (targets) {
+            int to = popLsb(targets);
+            if (!(attackersTo(to, occWithoutKing) & them)) {
+                moves.push(Move(kingSq, to, 0, (squareBB(to) & them) ? Move::CAPTURE : 0));
             }
         }
+        if (!checkers) generateCastling(moves);
     }
-}
-
-std::vector<Move> BoardState::generatePseudoLegalMovesFrom(int sq) const {
-    std::vector<Move> moves;
-    Piece p = board[sq];
     
-    if (p == NONE) return moves;
-    if (whiteToMove != Chess::isWhite(p)) return moves;
+    // Double check: only the king can move
+    if (checkers & (checkers - 1)) return;
+    if (stopAtFirst && !moves.empty()) return;
+    if (!checkers) checkMask = ~Bitboard(0);
     
-    int type = pieceType(p);
+    auto pinRayOf = [&](int sq) {
+        for (int dir = 0; dir < 8; dir++) {
+            if (pinRays[dir] & squareBB(sq)) return pinRays[dir];
+        }
+        return ~Bitboard(0);
+    };
     
-    switch (type) {
-        case 1: generatePawnMoves(sq, moves); break;
-        case 2: generateKnightMoves(sq, moves); break;
-        case 3: generateSlidingMoves(sq, BISHOP_DIRS, 4, moves); break;
-        case 4: generateSlidingMoves(sq, ROOK_DIRS, 4, moves); break;
-        case 5: generateSlidingMoves(sq, QUEEN_DIRS, 8, moves); break;
-        case 6: generateKingMoves(sq, moves); break;
+    const Bitboard pawns = typeBB[PAWN] & fromMask;
+    generatePawnMoves(pawns & ~pinned, checkMask, moves);
+    Bitboard pinnedPawns = pawns & pinned;
+    while (pinnedPawns) {
+        int sq = popLsb(pinnedPawns);
+        generatePawnMoves(squareBB(sq), checkMask & pinRayOf(sq), moves);
+    }
+    generateEnPassant(pawns, kingSq, moves);
+    if (stopAtFirst && !moves.empty()) return;
+    
+    // A pinned knight can never stay on its pin line
+    Bitboard knights = typeBB[KNIGHT] & fromMask & ~pinned;
+    while (knights) {
+        int sq = popLsb(knights);
+        addMoves(sq, knightAttacks(sq) & ~us & checkMask, them, moves);
+        if (stopAtFirst && !moves.empty()) return;
     }
     
-    return moves;
+    Bitboard sliders = (typeBB[BISHOP] | typeBB[ROOK] | typeBB[QUEEN]) & fromMask;
+    while (sliders) {
+        int sq = popLsb(sliders);
+        Bitboard attacks = 0;
+        if (typeBB[BISHOP] & squareBB(sq)) attacks = bishopAttacks(sq, occ);
+        else if (typeBB[ROOK] & squareBB(sq)) attacks = rookAttacks(sq, occ);
+        else attacks = bishopAttacks(sq, occ) | rookAttacks(sq, occ);
+        
+        Bitboard allowed = checkMask;
+        if (pinned & squareBB(sq)) allowed &= pinRayOf(sq);
+        addMoves(sq, attacks & ~us & allowed, them, moves);
+        if (stopAtFirst && !moves.empty()) return;
+    }
 }
 
-std::vector<Move> BoardState::generatePseudoLegalMoves() const {
-    std::vector<Move> moves;
-    for (int sq = 0; sq < 64; sq++) {
-        auto sqMoves = generatePseudoLegalMovesFrom(sq);
-        moves.insert(moves.end(), sqMoves.begin(), sqMoves.end());
-    }
-    return moves;
+void BoardState::generateLegalMoves(MoveList& moves) const {
+    moves.clear();
+    generateLegal(~Bitboard(0), moves);
 }
 
 std::vector<Move> BoardState::generateLegalMoves() const {
-    std::vector<Move> pseudo = generatePseudoLegalMoves();
-    std::vector<Move> legal;
-    
-    for (const Move& m : pseudo) {
-        BoardState after = applyMove(m);
-        int kingSq = after.findKing(whiteToMove);
-        if (kingSq >= 0 && !after.isAttacked(kingSq, !whiteToMove)) {
-            legal.push_back(m);
-        }
-    }
-    
-    return legal;
+    MoveList moves;
+    generateLegalMoves(moves);
+    return std::vector<Move>(moves.begin(), moves.end());
+}
+
+void BoardState::generateLegalMovesFrom(int sq, MoveList& moves) const {
+    moves.clear();
+    if (!isValidSquare(sq)) return;
+    generateLegal(squareBB(sq), moves);
 }
 
 std::vector<Move> BoardState::generateLegalMovesFrom(int sq) const {
-    std::vector<Move> pseudo = generatePseudoLegalMovesFrom(sq);
-    std::vector<Move> legal;
-    
-    for (const Move& m : pseudo) {
-        BoardState after = applyMove(m);
-        int kingSq = after.findKing(whiteToMove);
-        if (kingSq >= 0 && !after.isAttacked(kingSq, !whiteToMove)) {
-            legal.push_back(m);
-        }
-    }
-    
-    return legal;
+    MoveList moves;
+    generateLegalMovesFrom(sq, moves);
+    return std::vector<Move>(moves.begin(), moves.end());
 }
 
 bool BoardState::isLegalMove(const Move& move) const {
-    auto legal = generateLegalMovesFrom(move.from);
-    for (const Move& m : legal) {
-        if (m == move) return true;
+    const int from = move.from();
+    const int to = move.to();
+    if (!isValidSquare(from) || !isValidSquare(to) || from == to || move.promo() > 4) return false;
+    
+    const bool white = whiteToMove;
+    const Piece piece = board[from];
+    if (piece == NONE || isWhite(piece) != white) return false;
+    
+    const int kingSq = findKing(white);
+    if (kingSq < 0) return false;
+    
+    const Bitboard us = pieces(white);
+    const Bitboard them = pieces(!white);
+    const Bitboard occ = occupied();
+    const Bitboard toBB = squareBB(to);
+    if (toBB & us) return false;
+    
+    const int type = pieceType(piece);
+    const bool promotes = type == PAWN && rankOf(to) == (white ? 7 : 0);
+    if ((move.promo() > 0) != promotes) return false;
+    
+    // Geometry and blockers for the piece; kings finish here
+    switch (type) {
+        case PAWN: {
+            const int up = white ? 8 : -8;
+            const bool captures = (pawnAttacks(white, from) & toBB) != 0;
+            if (captures && to == epSquare) {
+                // The moving and captured pawns leave together; test the result
+                const Bitboard captured = squareBB(white ? to - 8 : to + 8);
+                const Bitboard after = (occ ^ squareBB(from) ^ captured) | toBB;
+                return !(attackersTo(kingSq, after) & them & ~captured);
+            }
+            if (captures) {
+                if (!(toBB & them)) return false;
+            } else if (to == from + up) {
+                if (occ & toBB) return false;
+            } else if (to == from + 2 * up && rankOf(from) == (white ? 1 : 6)) {
+                if (occ & (toBB | squareBB(from + up))) return false;
+            } else {
+                return false;
+            }
+            break;
+        }
+        case KNIGHT:
+            if (!(knightAttacks(from) & toBB)) return false;
+            break;
+        case BISHOP:
+            if (!(bishopAttacks(from, occ) & toBB)) return false;
+            break;
+        case ROOK:
+            if (!(rookAttacks(from, occ) & toBB)) return false;
+            break;
+        case QUEEN:
+            if (!((bishopAttacks(from, occ) | rookAttacks(from, occ)) & toBB)) return false;
+            break;
+        case KING:
+            if (from == (white ? 4 : 60) && (to == from + 2 || to == from - 2)) {
+                return !inCheck() && canCastle(to > from);
+            }
+            if (!(kingAttacks(from) & toBB)) return false;
+            return !(attackersTo(to, occ ^ squareBB(from)) & them);
     }
-    return false;
+    
+    // One king-safety test covers pins and checks: a captured piece no
+    // longer attacks, and the moved piece may now block.
+    const Bitboard after = (occ ^ squareBB(from)) | toBB;
+    return !(attackersTo(kingSq, after) & them & ~toBB);
 }
 
 BoardState BoardState::applyMove(const Move& move) const {
     BoardState newState = *this;
+    UndoInfo undo;
+    newState.makeMove(move, undo);
+    return newState;
+}
+
+void BoardState::makeMove(const Move& move, UndoInfo& undo) {
+    const bool white = whiteToMove;
+    const int from = move.from();
+    const int to = move.to();
+    const int promo = move.promo();
+    const Piece piece = board[from];
     
-    Piece piece = newState.board[move.from];
-    Piece captured = newState.board[move.to];
+    undo.move = move;
+    undo.captured = board[to];
+    undo.castling = castling;
+    undo.epSquare = epSquare;
+    undo.halfmoveClock = halfmoveClock;
+    undo.key = key;
     
-    newState.board[move.from] = NONE;
-    newState.board[move.to] = piece;
+    // Pieces update the key through set(); the rest is swapped out as a whole
+    key ^= stateKey();
     
-    if (move.promo > 0) {
-        Piece promoPieces[] = {NONE, 
-            whiteToMove ? W_KNIGHT : B_KNIGHT,
-            whiteToMove ? W_BISHOP : B_BISHOP,
-            whiteToMove ? W_ROOK : B_ROOK,
-            whiteToMove ? W_QUEEN : B_QUEEN
-        };
-        newState.board[move.to] = promoPieces[move.promo];
+    if ((piece == W_PAWN || piece == B_PAWN) && to == epSquare) {
+        int capturedPawnSq = white ? (to - 8) : (to + 8);
+        undo.captured = board[capturedPawnSq];
+        set(capturedPawnSq, NONE);
     }
     
-    if ((piece == W_PAWN || piece == B_PAWN) && move.to == epSquare) {
-        int capturedPawnSq = whiteToMove ? (move.to - 8) : (move.to + 8);
-        newState.board[capturedPawnSq] = NONE;
-    }
+    // Promo codes 1-4 map to piece types knight (2) through queen (5)
+    Piece placed = promo > 0 ? makePiece(promo + 1, white) : piece;
+    set(from, NONE);
+    set(to, placed);
     
     if (piece == W_KING) {
-        if (move.from == 4 && move.to == 6) {
-            newState.board[7] = NONE;
-            newState.board[5] = W_ROOK;
-        } else if (move.from == 4 && move.to == 2) {
-            newState.board[0] = NONE;
-            newState.board[3] = W_ROOK;
+        if (from == 4 && to == 6) {
+            set(7, NONE);
+            set(5, W_ROOK);
+        } else if (from == 4 && to == 2) {
+            set(0, NONE);
+            set(3, W_ROOK);
         }
-        newState.castling &= ~3;
+        castling &= ~3;
     } else if (piece == B_KING) {
-        if (move.from == 60 && move.to == 62) {
-            newState.board[63] = NONE;
-            newState.board[61] = B_ROOK;
-        } else if (move.from == 60 && move.to == 58) {
-            newState.board[56] = NONE;
-            newState.board[59] = B_ROOK;
+        if (from == 60 && to == 62) {
+            set(63, NONE);
+            set(61, B_ROOK);
+        } else if (from == 60 && to == 58) {
+            set(56, NONE);
+            set(59, B_ROOK);
         }
-        newState.castling &= ~12;
+        castling &= ~12;
     }
     
     if (piece == W_ROOK) {
-        if (move.from == 0) newState.castling &= ~2;
-        else if (move.from == 7) newState.castling &= ~1;
+        if (from == 0) castling &= ~2;
+        else if (from == 7) castling &= ~1;
     } else if (piece == B_ROOK) {
-        if (move.from == 56) newState.castling &= ~8;
-        else if (move.from == 63) newState.castling &= ~4;
+        if (from == 56) castling &= ~8;
+        else if (from == 63) castling &= ~4;
     }
     
-    if (move.to == 0) newState.castling &= ~2;
-    else if (move.to == 7) newState.castling &= ~1;
-    else if (move.to == 56) newState.castling &= ~8;
-    else if (move.to == 63) newState.castling &= ~4;
+    if (to == 0) castling &= ~2;
+    else if (to == 7) castling &= ~1;
+    else if (to == 56) castling &= ~8;
+    else if (to == 63) castling &= ~4;
+    
+    epSquare = -1;
+    if (piece == W_PAWN && rankOf(from) == 1 && rankOf(to) == 3) {
+        epSquare = from + 8;
+    } else if (piece == B_PAWN && rankOf(from) == 6 && rankOf(to) == 4) {
+        epSquare = from - 8;
+    }
+    
+    if (piece == W_PAWN || piece == B_PAWN || undo.captured != NONE) {
+        halfmoveClock = 0;
+    } else {
+        halfmoveClock++;
+    }
+    
+    if (!white) {
+        fullmoveNum++;
+    }
+    
+    whiteToMove = !white;
+    key ^= stateKey();
+}
+
+void BoardState::unmakeMove(const UndoInfo& undo) {
+    const Move& move = undo.move;
+    const int from = move.from();
+    const int to = move.to();
+    const int promo = move.promo();
+    const bool white = !whiteToMove;
+    whiteToMove = white;
     
-    newState.epSquare = -1;
-    if (piece == W_PAWN && rankOf(move.from) == 1 && rankOf(move.to) == 3) {
-        newState.epSquare = move.from + 8;
-    } else if (piece == B_PAWN && rankOf(move.from) == 6 && rankOf(move.to) == 4) {
-        newState.epSquare = move.from - 8;
+    if (!white) {
+        fullmoveNum--;
     }
     
-    newState.whiteToMove = !whiteToMove;
+    Piece piece = promo > 0 ? makePiece(PAWN, white) : board[to];
+    set(to, NONE);
+    set(from, piece);
     
-    if (piece == W_PAWN || piece == B_PAWN || captured != NONE) {
-        newState.halfmoveClock = 0;
+    if (pieceType(piece) == PAWN && to == undo.epSquare) {
+        set(white ? (to - 8) : (to + 8), undo.captured);
     } else {
-        newState.halfmoveClock = halfmoveClock + 1;
+        set(to, undo.captured);
     }
     
-    if (!whiteToMove) {
-        newState.fullmoveNum = fullmoveNum + 1;
+    if (piece == W_KING && from == 4) {
+        if (to == 6) {
+            set(5, NONE);
+            set(7, W_ROOK);
+        } else if (to == 2) {
+            set(3, NONE);
+            set(0, W_ROOK);
+        }
+    } else if (piece == B_KING && from == 60) {
+        if (to == 62) {
+            set(61, NONE);
+            set(63, B_ROOK);
+        } else if (to == 58) {
+            set(59, NONE);
+            set(56, B_ROOK);
+        }
     }
     
-    return newState;
+    castling = undo.castling;
+    epSquare = undo.epSquare;
+    halfmoveClock = undo.halfmoveClock;
+    key = undo.key;
 }
 
 bool BoardState::isCheckmate() const {
-    return inCheck() && generateLegalMoves().empty();
+    return inCheck() && !hasLegalMove();
 }
 
 bool BoardState::isStalemate() const {
-    return !inCheck() && generateLegalMoves().empty();
+    return !inCheck() && !hasLegalMove();
+}
+
+bool BoardState::hasLegalMove() const {
+    MoveList moves;
+    generateLegal(~Bitboard(0), moves, true);
+    return !moves.empty();
+}
+
+bool BoardState::isInsufficientMaterial() const {
+    if (typeBB[PAWN] | typeBB[ROOK] | typeBB[QUEEN]) return false;
+    
+    // A single minor piece cannot force mate
+    const Bitboard minors = typeBB[KNIGHT] | typeBB[BISHOP];
+    if (popCount(minors) <= 1) return true;
+    
+    // Bishops only, all on one square color
+    constexpr Bitboard DARK_SQUARES = 0xAA55AA55AA55AA55ULL;
+    if (typeBB[KNIGHT]) return false;
+    return !(typeBB[BISHOP] & DARK_SQUARES) || !(typeBB[BISHOP] & ~DARK_SQUARES);
+}
+
+GameStatus BoardState::gameStatus() const {
+    if (!hasLegalMove()) return inCheck() ? GameStatus::Checkmate : GameStatus::Stalemate;
+    if (halfmoveClock >= 100) return GameStatus::FiftyMoveRule;
+    if (isInsufficientMaterial()) return GameStatus::InsufficientMaterial;
+    return GameStatus::Ongoing;
 }
 
 BoardState BoardState::fromPacked(const uint8_t* data) {
@@ -453,55 +831,255 @@ BoardState BoardState::fromPacked(const uint8_t* data) {
         uint8_t byte = data[1 + i];
         int sq1 = i * 2;
         int sq2 = i * 2 + 1;
-        state.board[sq1] = static_cast<Piece>(byte & 0x0F);
-        state.board[sq2] = static_cast<Piece>((byte >> 4) & 0x0F);
+        uint8_t lo = byte & 0x0F;
+        uint8_t hi = (byte >> 4) & 0x0F;
+        state.board[sq1] = lo <= B_KING ? static_cast<Piece>(lo) : NONE;
+        state.board[sq2] = hi <= B_KING ? static_cast<Piece>(hi) : NONE;
     }
+    state.rebuildDerivedState();
     
     return state;
 }
 
-Puzzle Puzzle::fromRecord(const uint8_t* data, uint16_t recordSize) {
+int PuzzleView::moveCount() const {
+    return record[3] < MAX_SOLUTION_MOVES ? record[3] : MAX_SOLUTION_MOVES;
+}
+
+Move PuzzleView::move(int i) const {
+    const uint8_t* p = record + RECORD_MOVES_OFFSET + i * 2;
+    return Move::unpack(p[0] | (p[1] << 8));
+}
+
+Piece PuzzleView::pieceAt(int sq) const {
+    uint8_t byte = record[RECORD_BOARD_OFFSET + sq / 2];
+    uint8_t nibble = (sq & 1) ? (byte >> 4) : (byte & 0x0F);
+    return nibble <= B_KING ? static_cast<Piece>(nibble) : NONE;
+}
+
+BoardState PuzzleView::position() const {
+    uint8_t boardData[33];
+    boardData[0] = positionFlags();
+    memcpy(boardData + 1, record + RECORD_BOARD_OFFSET, 32);
+    return BoardState::fromPacked(boardData);
+}
+
+ThemeMask PuzzleView::themeMask() const {
+    if (size < 128) return 0;
+    ThemeMask mask = 0;
+    for (int i = 0; i < 8; i++) {
+        mask |= static_cast<ThemeMask>(record[RECORD_THEME_MASK_OFFSET + i]) << (8 * i);
+    }
+    return mask;
+}
+
+uint16_t PuzzleView::openingId() const {
+    if (size < 128) return 0;
+    return record[RECORD_OPENING_ID_OFFSET] | (record[RECORD_OPENING_ID_OFFSET + 1] << 8);
+}
+
+Puzzle PuzzleView::toPuzzle() const {
     Puzzle puzzle;
+    puzzle.rating = rating();
+    puzzle.position = position();
     
-    puzzle.rating = data[0] | (data[1] << 8);
+    const int count = moveCount();
+    puzzle.solution.reserve(count);
+    for (int i = 0; i < count; i++) {
+        puzzle.solution.push_back(move(i));
+    }
     
-    uint8_t flags = data[2];
-    uint8_t moveCount = data[3];
+    puzzle.themeMask = themeMask();
+    puzzle.openingId = openingId();
+    return puzzle;
+}
+
+Puzzle Puzzle::fromRecord(const uint8_t* data, uint16_t recordSize) {
+    return PuzzleView(data, recordSize).toPuzzle();
+}
+
+void PackStrings::clear() {
+    themes.clear();
+    openings.clear();
+}
+
+// Table: u8 theme count, u8-length-prefixed theme names, LE u16 opening
+// count, u8-length-prefixed opening names
+bool PackStrings::load(const uint8_t* data, size_t len) {
+    clear();
+    size_t pos = 0;
     
-    uint8_t boardData[33];
-    boardData[0] = flags;
-    memcpy(boardData + 1, data + 4, 32);
-    puzzle.position = BoardState::fromPacked(boardData);
+    auto readNames = [&](std::vector<std::string>& names, size_t count) {
+        names.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            if (pos >= len || len - pos - 1 < data[pos]) return false;
+            const size_t nameLen = data[pos++];
+            names.emplace_back(reinterpret_cast<const char*>(data + pos), nameLen);
+            pos += nameLen;
+        }
+        return true;
+    };
     
-    for (int i = 0; i < moveCount && i < 24; i++) {
-        int offset = 36 + i * 2;
-        uint16_t packed = data[offset] | (data[offset + 1] << 8);
-        puzzle.solution.push_back(Move::unpack(packed));
+    bool ok = pos < len && data[pos] <= MAX_PACK_THEMES;
+    ok = ok && readNames(themes, data[pos++]);
+    ok = ok && len - pos >= 2;
+    if (ok) {
+        const size_t openingCount = data[pos] | (data[pos + 1] << 8);
+        pos += 2;
+        ok = readNames(openings, openingCount);
     }
+    if (!ok) clear();
+    return ok;
+}
+
+std::string_view PackStrings::theme(int bit) const {
+    if (bit < 0 || bit >= themeCount()) return std::string_view();
+    return themes[bit];
+}
+
+ThemeMask PackStrings::themeBit(std::string_view name) const {
+    for (int i = 0; i < themeCount(); i++) {
+        if (themes[i] == name) return ThemeMask(1) << i;
+    }
+    return 0;
+}
+
+std::string_view PackStrings::opening(uint16_t id) const {
+    if (id == 0 || id > openings.size()) return std::string_view();
+    return openings[id - 1];
+}
 
-    puzzle.themes.clear();
-    puzzle.opening.clear();
-    if (recordSize >= 128) {
-        puzzle.themes = readRecordField(data, 84, 32);
-        puzzle.opening = readRecordField(data, 116, 12);
+void PackStrings::internRecord(uint8_t* record, uint16_t recordSize) {
+    if (recordSize < 128) return;
+    
+    ThemeMask mask = 0;
+    std::string_view list = recordField(record, RECORD_THEMES_OFFSET, 32);
+    while (!list.empty()) {
+        const size_t comma = list.find(',');
+        const std::string_view name = list.substr(0, comma);
+        ThemeMask bit = themeBit(name);
+        if (!bit && !name.empty() && themeCount() < MAX_PACK_THEMES) {
+            bit = ThemeMask(1) << themeCount();
+            themes.emplace_back(name);
+        }
+        mask |= bit;
+        if (comma == std::string_view::npos) break;
+        list.remove_prefix(comma + 1);
     }
     
-    return puzzle;
+    uint16_t openingId = 0;
+    const std::string_view opening = recordField(record, RECORD_OPENING_OFFSET, 12);
+    if (!opening.empty()) {
+        for (size_t i = 0; i < openings.size() && !openingId; i++) {
+            if (openings[i] == opening) openingId = static_cast<uint16_t>(i + 1);
+        }
+        if (!openingId && openings.size() < 0xFFFF) {
+            openings.emplace_back(opening);
+            openingId = static_cast<uint16_t>(openings.size());
+        }
+    }
+    
+    memset(record + RECORD_THEMES_OFFSET, 0, 128 - RECORD_THEMES_OFFSET);
+    for (int i = 0; i < 8; i++) {
+        record[RECORD_THEME_MASK_OFFSET + i] = static_cast<uint8_t>(mask >> (8 * i));
+    }
+    record[RECORD_OPENING_ID_OFFSET] = openingId & 0xFF;
+    record[RECORD_OPENING_ID_OFFSET + 1] = openingId >> 8;
 }
 
-bool PackHeader::fromFile(const uint8_t* headerData, PackHeader& out) {
-    if (headerData[0] != 'C' || headerData[1] != 'P' || 
-        headerData[2] != 'Z' || headerData[3] != '1') {
+bool PackHeader::fromFile(const uint8_t* headerData, size_t size, PackHeader& out) {
+    if (size < PACK_HEADER_SIZE || headerData[0] != 'C' || headerData[1] != 'P' || headerData[2] != 'Z') {
         return false;
     }
     
+    out = PackHeader();
     out.recordSize = headerData[4] | (headerData[5] << 8);
     out.puzzleCount = headerData[6] | (headerData[7] << 8) | 
                       (headerData[8] << 16) | (headerData[9] << 24);
     out.ratingMin = headerData[10] | (headerData[11] << 8);
     out.ratingMax = headerData[12] | (headerData[13] << 8);
     
-    return true;
+    if (headerData[3] == '1') {
+        out.version = 1;
+        return true;
+    }
+    if (headerData[3] != '2' || size < PACK2_HEADER_SIZE) {
+        return false;
+    }
+    
+    out.version = 2;
+    out.blockRecords = headerData[14] | (headerData[15] << 8);
+    out.blockCount = readLE32(headerData + 16);
+    out.indexOffset = readLE32(headerData + 20);
+    out.stringsOffset = readLE32(headerData + 24);
+    if (out.recordSize != PACK2_RECORD_SIZE || out.blockRecords == 0) {
+        return false;
+    }
+    return out.blockCount == (out.puzzleCount + out.blockRecords - 1) / out.blockRecords;
+}
+
+// CPZ2 record: flags, moveCount, varint rating, LE u64 occupancy, one nibble
+// per occupied square (ascending, low nibble first), moveCount LE u16 moves,
+// varint theme mask, varint opening id.
+size_t expandPackedRecord(const uint8_t* data, size_t len, uint8_t* record) {
+    size_t pos = 0;
+    auto readVarint = [&](int maxBits, uint64_t& value) {
+        value = 0;
+        for (int shift = 0;; shift += 7) {
+            if (pos >= len || shift >= maxBits) return false;
+            const uint8_t byte = data[pos++];
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+    };
+    
+    if (len < 2) return 0;
+    const uint8_t flags = data[pos++];
+    const uint8_t moveCount = data[pos++];
+    if (moveCount > MAX_SOLUTION_MOVES) return 0;
+    
+    uint64_t rating = 0;
+    if (!readVarint(16, rating) || rating > 0xFFFF || len - pos < 8) return 0;
+    
+    Bitboard occupied = 0;
+    for (int i = 0; i < 8; i++) {
+        occupied |= static_cast<Bitboard>(data[pos + i]) << (8 * i);
+    }
+    pos += 8;
+    
+    const size_t pieceBytes = (popCount(occupied) + 1) / 2;
+    const size_t moveBytes = moveCount * 2;
+    if (len - pos < pieceBytes + moveBytes) return 0;
+    const uint8_t* nibbles = data + pos;
+    pos += pieceBytes;
+    const uint8_t* moves = data + pos;
+    pos += moveBytes;
+    
+    uint64_t themeMask = 0;
+    uint64_t openingId = 0;
+    if (!readVarint(64, themeMask) || !readVarint(16, openingId) || openingId > 0xFFFF) return 0;
+    
+    if (!record) return pos;
+    
+    memset(record, 0, PACK2_RECORD_SIZE);
+    record[0] = rating & 0xFF;
+    record[1] = rating >> 8;
+    record[2] = flags;
+    record[3] = moveCount;
+    
+    int piece = 0;
+    for (Bitboard bb = occupied; bb; piece++) {
+        const int sq = popLsb(bb);
+        const uint8_t nibble = (nibbles[piece / 2] >> ((piece & 1) * 4)) & 0x0F;
+        record[RECORD_BOARD_OFFSET + sq / 2] |= (sq & 1) ? nibble << 4 : nibble;
+    }
+    
+    memcpy(record + RECORD_MOVES_OFFSET, moves, moveBytes);
+    for (int i = 0; i < 8; i++) {
+        record[RECORD_THEME_MASK_OFFSET + i] = static_cast<uint8_t>(themeMask >> (8 * i));
+    }
+    record[RECORD_OPENING_ID_OFFSET] = openingId & 0xFF;
+    record[RECORD_OPENING_ID_OFFSET + 1] = openingId >> 8;
+    return pos;
 }
 
 }
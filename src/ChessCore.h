@@ -1,7 +1,9 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace Chess {
@@ -26,34 +28,139 @@ inline int pieceType(Piece p) {
     return isWhite(p) ? p : (p - 6);
 }
 
+// Piece type (1-6) as returned by pieceType()
+enum PieceType : uint8_t {
+    PAWN = 1, KNIGHT = 2, BISHOP = 3, ROOK = 4, QUEEN = 5, KING = 6
+};
+
+// Material values in centipawns, indexed by pieceType(). Kings are not counted.
+constexpr int16_t PIECE_VALUES[7] = {0, 100, 320, 330, 500, 900, 0};
+
+// Color index used by the bitboard arrays: 0 = white, 1 = black
+inline int colorIndex(bool white) { return white ? 0 : 1; }
+
+// Build a piece from type (1-6) and color
+inline Piece makePiece(int type, bool white) {
+    return static_cast<Piece>(white ? type : type + 6);
+}
+
+// ============================================================================
+// Bitboards
+// ============================================================================
+
+// One bit per square, using the same a1=0 .. h8=63 numbering as the mailbox
+typedef uint64_t Bitboard;
+
+constexpr Bitboard squareBB(int sq) { return Bitboard(1) << sq; }
+inline int popCount(Bitboard b) { return __builtin_popcountll(b); }
+inline int lsb(Bitboard b) { return __builtin_ctzll(b); }
+inline int msb(Bitboard b) { return 63 - __builtin_clzll(b); }
+
+// Remove and return the lowest set square (b must be non-zero)
+inline int popLsb(Bitboard& b) {
+    int sq = lsb(b);
+    b &= b - 1;
+    return sq;
+}
+
 // ============================================================================
 // Move representation
 // ============================================================================
 
-// Compact move: from(6) | to(6) | promo(4) packed into 16 bits
-// Promo: 0=none, 1=knight, 2=bishop, 3=rook, 4=queen
+// Packed 32-bit move:
+//   bits  0-5   from square
+//   bits  6-11  to square
+//   bits 12-15  promotion: 0=none, 1=knight, 2=bishop, 3=rook, 4=queen
+//   bits 16-19  Flag bits, filled in by the move generator
+//   bits 20-31  signed ordering score, free for move pickers
+// The low 16 bits are the pack() storage format. Only they take part in
+// comparisons, so a move typed by the player or read from a pack (no flags,
+// no score) still equals the generated one.
 struct Move {
-    uint8_t from;
-    uint8_t to;
-    uint8_t promo;  // 0=none, 1=N, 2=B, 3=R, 4=Q
+    enum Flag : uint8_t {
+        CAPTURE = 1,      // Includes en passant
+        EN_PASSANT = 2,
+        CASTLE = 4,
+        DOUBLE_PUSH = 8
+    };
     
-    Move() : from(0), to(0), promo(0) {}
-    Move(uint8_t f, uint8_t t, uint8_t p = 0) : from(f), to(t), promo(p) {}
+    static constexpr int MIN_SCORE = -2048;
+    static constexpr int MAX_SCORE = 2047;
     
-    bool operator==(const Move& other) const {
-        return from == other.from && to == other.to && promo == other.promo;
-    }
+    uint32_t data;
     
-    bool isNull() const { return from == to; }
+    Move() : data(0) {}
+    Move(int from, int to, int promo = 0, int flags = 0)
+        : data(static_cast<uint32_t>((from & 0x3F) | ((to & 0x3F) << 6) | ((promo & 0x0F) << 12) |
+                                     ((flags & 0x0F) << 16))) {}
     
-    // Pack to 16-bit (for storage)
-    uint16_t pack() const {
-        return (from & 0x3F) | ((to & 0x3F) << 6) | ((promo & 0x0F) << 12);
+    int from() const { return data & 0x3F; }
+    int to() const { return (data >> 6) & 0x3F; }
+    int promo() const { return (data >> 12) & 0x0F; }
+    int flags() const { return (data >> 16) & 0x0F; }
+    
+    bool isCapture() const { return (flags() & CAPTURE) != 0; }
+    bool isEnPassant() const { return (flags() & EN_PASSANT) != 0; }
+    bool isCastle() const { return (flags() & CASTLE) != 0; }
+    bool isDoublePush() const { return (flags() & DOUBLE_PUSH) != 0; }
+    
+    // Ordering score, clamped to [MIN_SCORE, MAX_SCORE]
+    int score() const { return static_cast<int32_t>(data) >> 20; }
+    void setScore(int s) {
+        s = s < MIN_SCORE ? MIN_SCORE : (s > MAX_SCORE ? MAX_SCORE : s);
+        data = (data & 0xFFFFF) | (static_cast<uint32_t>(s) << 20);
     }
     
+    bool operator==(const Move& other) const { return pack() == other.pack(); }
+    bool operator!=(const Move& other) const { return !(*this == other); }
+    
+    bool isNull() const { return from() == to(); }
+    
+    // Pack to 16-bit (for storage); drops flags and score
+    uint16_t pack() const { return static_cast<uint16_t>(data); }
+    
     // Unpack from 16-bit
     static Move unpack(uint16_t val) {
-        return Move(val & 0x3F, (val >> 6) & 0x3F, (val >> 12) & 0x0F);
+        Move m;
+        m.data = val;
+        return m;
+    }
+};
+
+static_assert(sizeof(Move) == 4, "Move must stay one 32-bit word");
+
+// Fixed-capacity move buffer meant to live on the stack. 256 entries cover the
+// largest move count of any reachable position (218), so generating into a
+// MoveList never touches the heap.
+struct MoveList {
+    static constexpr int CAPACITY = 256;
+    
+    Move moves[CAPACITY];
+    int count;
+    
+    MoveList() : count(0) {}
+    
+    void push(const Move& m) {
+        if (count < CAPACITY) moves[count++] = m;
+    }
+    void clear() { count = 0; }
+    
+    size_t size() const { return static_cast<size_t>(count); }
+    bool empty() const { return count == 0; }
+    
+    Move& operator[](size_t i) { return moves[i]; }
+    const Move& operator[](size_t i) const { return moves[i]; }
+    
+    Move* begin() { return moves; }
+    Move* end() { return moves + count; }
+    const Move* begin() const { return moves; }
+    const Move* end() const { return moves + count; }
+    
+    bool contains(const Move& m) const {
+        for (int i = 0; i < count; i++) {
+            if (moves[i] == m) return true;
+        }
+        return false;
     }
 };
 
@@ -61,8 +168,38 @@ struct Move {
 // Board state
 // ============================================================================
 
+// Result of BoardState::gameStatus(), for the side to move
+enum class GameStatus : uint8_t {
+    Ongoing,
+    Checkmate,
+    Stalemate,
+    FiftyMoveRule,        // 100 half-moves without a capture or pawn move
+    InsufficientMaterial  // Neither side can mate (K vs K, single minor, same-colored bishops)
+};
+
+// Everything makeMove() overwrites that cannot be re-derived from the move.
+// Keep one per ply on a stack to walk a line forwards and back.
+struct UndoInfo {
+    Move move;
+    Piece captured;        // Piece removed by the move (the pawn for en passant)
+    uint8_t castling;
+    int8_t epSquare;
+    uint8_t halfmoveClock;
+    uint64_t key;
+};
+
+// The mailbox (`board`) is the canonical piece layout. The bitboards, king
+// squares, piece counts, material and Zobrist key mirror it and are updated
+// incrementally by set()/makeMove(); call rebuildDerivedState() after writing
+// board[], whiteToMove, castling or epSquare directly.
 struct BoardState {
     Piece board[64];       // a1=0, h1=7, a8=56, h8=63
+    Bitboard typeBB[7];    // Indexed by pieceType(); typeBB[0] = all occupied squares
+    Bitboard colorBB[2];   // Indexed by colorIndex()
+    int8_t kingSq[2];      // Indexed by colorIndex(); -1 if that side has no king
+    uint8_t pieceCount[13];// Indexed by Piece
+    int16_t material[2];   // Sum of PIECE_VALUES per colorIndex()
+    uint64_t key;          // Zobrist key: pieces, side to move, castling, ep file
     bool whiteToMove;
     uint8_t castling;      // bit 0: K, bit 1: Q, bit 2: k, bit 3: q
     int8_t epSquare;       // -1 if none, otherwise the en passant target square
@@ -79,79 +216,226 @@ struct BoardState {
     
     // Piece access
     Piece at(int sq) const { return board[sq]; }
-    void set(int sq, Piece p) { board[sq] = p; }
+    void set(int sq, Piece p);
+    
+    // Bitboard access
+    Bitboard occupied() const { return typeBB[0]; }
+    Bitboard pieces(bool white) const { return colorBB[colorIndex(white)]; }
+    Bitboard pieces(int type, bool white) const { return typeBB[type] & colorBB[colorIndex(white)]; }
     
-    // Find king
-    int findKing(bool white) const;
+    // Piece counts and material
+    int countOf(Piece p) const { return pieceCount[p]; }
+    int materialOf(bool white) const { return material[colorIndex(white)]; }
+    
+    // Recompute bitboards, king squares, counts, material and key from
+    // board[] and the side/castling/ep fields
+    void rebuildDerivedState();
+    
+    // Find king (O(1), tracked incrementally)
+    int findKing(bool white) const { return kingSq[colorIndex(white)]; }
     
     // Check if a square is attacked by the given side
     bool isAttacked(int sq, bool byWhite) const;
     
+    // Every piece (both colors) attacking sq, given an occupancy. Sliders see
+    // through squares missing from occ, which gives x-ray attacks.
+    Bitboard attackersTo(int sq, Bitboard occ) const;
+    Bitboard attackersTo(int sq) const { return attackersTo(sq, occupied()); }
+    Bitboard attackersTo(int sq, bool byWhite) const { return attackersTo(sq) & pieces(byWhite); }
+    
+    // Static exchange evaluation: net material (centipawns) the side making
+    // `move` wins if both sides keep recapturing on the target square with
+    // their least valuable attacker, each free to stop when behind. Pins are
+    // ignored. Quiet moves score the loss of the moving piece, if any.
+    int see(const Move& move) const;
+    
     // Check if the side to move is in check
     bool inCheck() const;
     
     // Generate all legal moves for the side to move
+    void generateLegalMoves(MoveList& moves) const;
     std::vector<Move> generateLegalMoves() const;
     
     // Generate legal moves for a specific piece at a square
+    void generateLegalMovesFrom(int sq, MoveList& moves) const;
     std::vector<Move> generateLegalMovesFrom(int sq) const;
     
-    // Check if a move is legal (validates and checks for leaving king in check)
+    // Check if a move is legal (validates and checks for leaving king in check).
+    // Tests the one move directly; no move list is generated.
     bool isLegalMove(const Move& move) const;
     
     // Apply a move and return the new state
     BoardState applyMove(const Move& move) const;
     
+    // Apply a move in place, recording what is needed to take it back.
+    // The move must be legal (or at least pseudo-legal) for this position.
+    void makeMove(const Move& move, UndoInfo& undo);
+    
+    // Take back the move recorded by the matching makeMove() call
+    void unmakeMove(const UndoInfo& undo);
+    
     // Check for checkmate or stalemate
     bool isCheckmate() const;
     bool isStalemate() const;
     
+    // True as soon as one legal move is found (king moves are tried first)
+    bool hasLegalMove() const;
+    
+    // Neither side has mating material
+    bool isInsufficientMaterial() const;
+    
+    // Mate and stalemate take priority over the draw rules
+    GameStatus gameStatus() const;
+    
     // Parse from packed binary (matches packer format)
     static BoardState fromPacked(const uint8_t* data);
     
 private:
-    // Generate pseudo-legal moves (may leave king in check)
-    std::vector<Move> generatePseudoLegalMoves() const;
-    std::vector<Move> generatePseudoLegalMovesFrom(int sq) const;
+    // Add/remove a piece on sq and update the derived state
+    void putPiece(int sq, Piece p);
+    void removePiece(int sq);
     
-    // Sliding piece move generation
-    void generateSlidingMoves(int sq, const int* directions, int numDirs, 
-                              std::vector<Move>& moves) const;
+    // Key contribution of side to move, castling rights and en passant file
+    uint64_t stateKey() const;
     
-    // Pawn move generation
-    void generatePawnMoves(int sq, std::vector<Move>& moves) const;
+    // Generate legal moves for the side to move's pieces in fromMask. Checkers
+    // and pins are computed once up front, so no candidate is made and tested.
+    // With stopAtFirst set, returns once at least one move has been added.
+    void generateLegal(Bitboard fromMask, MoveList& moves, bool stopAtFirst = false) const;
     
-    // Knight move generation
-    void generateKnightMoves(int sq, std::vector<Move>& moves) const;
+    // Pawn pushes and captures (en passant excluded) landing in `allowed`
+    void generatePawnMoves(Bitboard pawns, Bitboard allowed, MoveList& moves) const;
     
-    // King move generation (including castling)
-    void generateKingMoves(int sq, std::vector<Move>& moves) const;
+    // En passant captures, each verified against the resulting occupancy
+    void generateEnPassant(Bitboard pawns, int kingSq, MoveList& moves) const;
+    
+    // Castling (caller guarantees the king is not in check)
+    void generateCastling(MoveList& moves) const;
+    
+    // Rights, rook, empty path and unattacked king path for one castle.
+    // Does not test whether the king is currently in check.
+    bool canCastle(bool kingSide) const;
 };
 
 // ============================================================================
 // Puzzle data
 // ============================================================================
 
+static constexpr int RECORD_SIZE = 96;
+static constexpr int MAX_RECORD_SIZE = 1024;
+static constexpr int MAX_SOLUTION_MOVES = 24;
+static constexpr int PACK_HEADER_SIZE = 18;
+static constexpr int PACK2_HEADER_SIZE = 32;
+static constexpr int PACK2_RECORD_SIZE = 128;    // CPZ2 records expand to the 128-byte CPZ1 layout
+static constexpr int MAX_PACKED_RECORD_SIZE = 96;
+static constexpr int MAX_PACK_THEMES = 64;
+
+// Theme i of a pack's string table is bit i
+using ThemeMask = uint64_t;
+
 struct Puzzle {
     uint16_t rating;
     BoardState position;
     std::vector<Move> solution;
-    std::string themes;
-    std::string opening;
+    ThemeMask themeMask;
+    uint16_t openingId;      // PackStrings::opening() index; 0 if none
     
     static Puzzle fromRecord(const uint8_t* data, uint16_t recordSize);
 };
 
+// Theme and opening names of a pack, stored once instead of in every record.
+// CPZ2 packs carry the table; for CPZ1 packs it is built up as records are
+// read, by internRecord().
+class PackStrings {
+public:
+    // Parse a CPZ2 string table. Returns false, leaving the table empty, if
+    // it is malformed.
+    bool load(const uint8_t* data, size_t len);
+    void clear();
+    
+    int themeCount() const { return static_cast<int>(themes.size()); }
+    std::string_view theme(int bit) const;
+    // Mask bit of the named theme, or 0 if the pack has no such theme
+    ThemeMask themeBit(std::string_view name) const;
+    
+    // Opening id 0 means none and has an empty name
+    std::string_view opening(uint16_t id) const;
+    
+    // Replace the text themes and opening of a 128-byte CPZ1 record with
+    // the theme mask and opening id that PuzzleView reads, adding names not
+    // seen before. Records shorter than 128 bytes have no text to replace.
+    void internRecord(uint8_t* record, uint16_t recordSize);
+    
+private:
+    std::vector<std::string> themes;
+    std::vector<std::string> openings;  // Opening id i + 1
+};
+
+// Non-owning view of one pack record as returned by PackReader: the CPZ1
+// layout (tools/pack_lichess_cpz.py) with the text fields interned (see
+// PackStrings::internRecord). Fields are decoded from the buffer on each
+// call and nothing is allocated, so scanning many records is cheap. The
+// buffer must outlive the view.
+class PuzzleView {
+public:
+    PuzzleView() = default;
+    PuzzleView(const uint8_t* data, uint16_t recordSize) : record(data), size(recordSize) {}
+    
+    bool valid() const { return record != nullptr && size >= RECORD_SIZE; }
+    
+    uint16_t rating() const { return record[0] | (record[1] << 8); }
+    uint8_t positionFlags() const { return record[2]; }  // fromPacked() flags byte
+    bool whiteToMove() const { return (record[2] & 1) != 0; }
+    
+    // Solution length, capped at MAX_SOLUTION_MOVES
+    int moveCount() const;
+    Move move(int i) const;
+    
+    Piece pieceAt(int sq) const;
+    BoardState position() const;
+    
+    // 0 for records shorter than 128 bytes
+    ThemeMask themeMask() const;
+    uint16_t openingId() const;
+    
+    // True if the puzzle has any of the themes in mask
+    bool hasAnyTheme(ThemeMask mask) const { return (themeMask() & mask) != 0; }
+    
+    // Owning copy, for the puzzle being played
+    Puzzle toPuzzle() const;
+    
+private:
+    const uint8_t* record = nullptr;
+    uint16_t size = 0;
+};
+
+// CPZ1 stores fixed-size records right after an 18-byte header. CPZ2 packs
+// records without padding into blocks of blockRecords and keeps the file
+// offset of every block in an index, so one record is found by reading one
+// index entry and decoding at most one block. Layouts are documented in
+// tools/pack_lichess_cpz.py.
 struct PackHeader {
-    uint16_t recordSize;
+    uint8_t version;
+    uint16_t recordSize;     // Bytes per record as PuzzleView sees it (expanded for CPZ2)
     uint32_t puzzleCount;
     uint16_t ratingMin;
     uint16_t ratingMax;
     
-    static bool fromFile(const uint8_t* headerData, PackHeader& out);
+    // CPZ2 only
+    uint16_t blockRecords;   // Records per block; the last block may hold fewer
+    uint32_t blockCount;
+    uint32_t indexOffset;    // blockCount + 1 LE u32 offsets, the last one is the end of the data
+    uint32_t stringsOffset;  // String table, from here to the end of the file
+    
+    // headerData holds the first `size` bytes of the file
+    static bool fromFile(const uint8_t* headerData, size_t size, PackHeader& out);
+    int headerSize() const { return version == 2 ? PACK2_HEADER_SIZE : PACK_HEADER_SIZE; }
 };
 
-static constexpr int RECORD_SIZE = 96;
-static constexpr int PACK_HEADER_SIZE = 18;
+// Expand one packed CPZ2 record at data (at most len bytes available) into a
+// PACK2_RECORD_SIZE-byte record. Returns the bytes consumed, or 0 if the
+// input is malformed or truncated. With record == nullptr the record is only
+// measured, to skip over it.
+size_t expandPackedRecord(const uint8_t* data, size_t len, uint8_t* record);
 
 }  // namespace Chess
@@ -53,6 +53,20 @@ void ChessPuzzlesApp::onEnter() {
     Serial.println("[CHESS] Failed to load sprites from SD card");
   }
 
+  // Size the engine's transposition table once, from what the heap can spare.
+  const uint32_t freeHeap = esp_get_free_heap_size();
+  size_t ttBytes = TT_MIN_BYTES;
+  while (ttBytes * 2 <= TT_MAX_BYTES && ttBytes * 2 * 4 <= freeHeap) {
+    ttBytes *= 2;
+  }
+  if (!engine.resizeTable(ttBytes)) {
+    logEvent("ENGINE", "tt alloc failed bytes=%lu free=%lu", static_cast<unsigned long>(ttBytes),
+             static_cast<unsigned long>(freeHeap));
+  } else {
+    logEvent("ENGINE", "tt bytes=%lu entries=%lu free=%lu", static_cast<unsigned long>(engine.table().sizeBytes()),
+             static_cast<unsigned long>(engine.table().capacity()), static_cast<unsigned long>(freeHeap));
+  }
+
   renderingMutex = xSemaphoreCreateMutex();
 
   currentMode = Mode::PackSelect;
@@ -79,6 +93,9 @@ void ChessPuzzlesApp::onExit() {
   }
 
   ChessSprites::freeSprites();
+  engine.releaseTable();
+  pack.close();
+  ratingIndex.close();
 }
 
 void ChessPuzzlesApp::logEvent(const char* ev, const char* fmt, ...) const {
@@ -108,6 +125,8 @@ void ChessPuzzlesApp::logModeChange(Mode from, Mode to, const char* reason) {
         return "PackMenu";
       case Mode::ThemeSelect:
         return "ThemeSelect";
+      case Mode::RatingSelect:
+        return "RatingSelect";
       case Mode::Browsing:
         return "Browsing";
       case Mode::Playing:
@@ -122,6 +141,30 @@ void ChessPuzzlesApp::logModeChange(Mode from, Mode to, const char* reason) {
 }
 
 void ChessPuzzlesApp::loop() {
+  handleInput();
+
+  // Idle pass: no button activity and nothing waiting to be drawn, so read
+  // ahead without delaying the response to a press. Skipped while a frame is
+  // still being drawn rather than waiting on it in readPackRecord().
+  if (!updateRequired && !inputPending() &&
+      (currentMode == Mode::Playing || currentMode == Mode::InGameMenu) &&
+      xSemaphoreTake(renderingMutex, 0) == pdTRUE) {
+    xSemaphoreGive(renderingMutex);
+    prefetchNextPuzzle();
+  }
+}
+
+bool ChessPuzzlesApp::inputPending() const {
+  if (input_.wasAnyPressed() || input_.wasAnyReleased()) {
+    return true;
+  }
+  for (uint8_t button = HalGPIO::BTN_BACK; button <= HalGPIO::BTN_POWER; button++) {
+    if (input_.isPressed(button)) return true;
+  }
+  return false;
+}
+
+void ChessPuzzlesApp::handleInput() {
   if (currentMode == Mode::PackSelect) {
     if (input_.wasPressed(HalGPIO::BTN_UP) || input_.wasPressed(HalGPIO::BTN_LEFT)) {
       if (packSelectorIndex > 0) {
@@ -177,8 +220,8 @@ void ChessPuzzlesApp::loop() {
         case PackMenuItem::Continue: {
           uint32_t savedIndex = loadProgress();
           if (savedIndex >= puzzleCount) savedIndex = 0;
-          activeTheme.clear();
-          themeBitset.clear();
+          clearTheme();
+          ratingWindowActive = false;
            if (loadPuzzleFromPack(savedIndex)) {
              logModeChange(currentMode, Mode::Playing, "continue");
              currentMode = Mode::Playing;
@@ -186,23 +229,27 @@ void ChessPuzzlesApp::loop() {
            break;
          }
         case PackMenuItem::Random:
-          activeTheme.clear();
-          themeBitset.clear();
+          clearTheme();
+          ratingWindowActive = false;
           loadRandomPuzzle();
           logModeChange(currentMode, Mode::Playing, "random");
           currentMode = Mode::Playing;
           break;
         case PackMenuItem::Themes:
           loadAvailableThemes();
-          themeSelectIndex = 0;
+          themeSelectIndex = THEME_OPTION_ROWS;  // First theme
           logModeChange(currentMode, Mode::ThemeSelect, "themes");
           currentMode = Mode::ThemeSelect;
           break;
+        case PackMenuItem::Rating:
+          logModeChange(currentMode, Mode::RatingSelect, "rating");
+          currentMode = Mode::RatingSelect;
+          break;
         case PackMenuItem::Browse: {
           browserIndex = loadProgress();
           if (browserIndex >= puzzleCount) browserIndex = 0;
-          activeTheme.clear();
-          themeBitset.clear();
+          clearTheme();
+          ratingWindowActive = false;
           logModeChange(currentMode, Mode::Browsing, "browse");
           currentMode = Mode::Browsing;
           break;
@@ -210,6 +257,9 @@ void ChessPuzzlesApp::loop() {
       }
       updateRequired = true;
     } else if (input_.wasReleased(HalGPIO::BTN_BACK)) {
+      clearTheme();
+      pack.close();
+      ratingIndex.close();
       logModeChange(currentMode, Mode::PackSelect, "back");
       currentMode = Mode::PackSelect;
       updateRequired = true;
@@ -218,22 +268,43 @@ void ChessPuzzlesApp::loop() {
   }
 
   if (currentMode == Mode::ThemeSelect) {
-    if (input_.wasPressed(HalGPIO::BTN_UP) || input_.wasPressed(HalGPIO::BTN_LEFT)) {
+    // The option rows come first, then one row per theme
+    const int rowCount = availableThemes.empty() ? 0 : THEME_OPTION_ROWS + static_cast<int>(availableThemes.size());
+    if (input_.wasPressed(HalGPIO::BTN_UP)) {
       if (themeSelectIndex > 0) {
         themeSelectIndex--;
         updateRequired = true;
       }
-    } else if (input_.wasPressed(HalGPIO::BTN_DOWN) || input_.wasPressed(HalGPIO::BTN_RIGHT)) {
-      if (themeSelectIndex < static_cast<int>(availableThemes.size()) - 1) {
+    } else if (input_.wasPressed(HalGPIO::BTN_DOWN)) {
+      if (themeSelectIndex < rowCount - 1) {
         themeSelectIndex++;
         updateRequired = true;
       }
+    } else if (input_.wasPressed(HalGPIO::BTN_LEFT) || input_.wasPressed(HalGPIO::BTN_RIGHT)) {
+      if (rowCount > 0) {
+        toggleThemeRow(themeSelectIndex, input_.wasPressed(HalGPIO::BTN_RIGHT) ? 1 : -1);
+        updateRequired = true;
+      }
     } else if (input_.wasReleased(HalGPIO::BTN_CONFIRM)) {
-      if (!availableThemes.empty()) {
-        activeTheme = availableThemes[themeSelectIndex];
-        loadThemeBitset(activeTheme);
-        loadRandomThemedPuzzle();
-        logEvent("THEME", "selected=%s", activeTheme.c_str());
+      if (rowCount > 0 && themeSelectIndex < THEME_OPTION_ROWS) {
+        toggleThemeRow(themeSelectIndex, 1);
+        updateRequired = true;
+      } else if (rowCount > 0) {
+        const int theme = themeSelectIndex - THEME_OPTION_ROWS;
+        const bool anyToggled = std::any_of(themeToggles.begin(), themeToggles.end(),
+                                            [](ThemeToggle t) { return t != ThemeToggle::Off; });
+        if (anyToggled || queryUnsolvedOnly || queryRatingWindow) {
+          startThemeQuery(theme);
+          loadNextQueryPuzzle();
+        } else {
+          // Just the highlighted theme: random picks that prefer unsolved puzzles
+          clearTheme();
+          ratingWindowActive = false;
+          activeTheme = availableThemes[theme];
+          loadThemeBitmap(activeTheme);
+          loadRandomThemedPuzzle();
+          logEvent("THEME", "selected=%s", activeTheme.c_str());
+        }
         logModeChange(currentMode, Mode::Playing, "theme selected");
         currentMode = Mode::Playing;
         updateRequired = true;
@@ -246,6 +317,35 @@ void ChessPuzzlesApp::loop() {
     return;
   }
 
+  if (currentMode == Mode::RatingSelect) {
+    if (input_.wasPressed(HalGPIO::BTN_UP) || input_.wasPressed(HalGPIO::BTN_RIGHT)) {
+      if (ratingIndex.isOpen() && ratingTarget + RATING_STEP <= ratingIndex.ratingMax()) {
+        ratingTarget += RATING_STEP;
+        updateRequired = true;
+      }
+    } else if (input_.wasPressed(HalGPIO::BTN_DOWN) || input_.wasPressed(HalGPIO::BTN_LEFT)) {
+      if (ratingIndex.isOpen() && ratingTarget >= ratingIndex.ratingMin() + RATING_STEP) {
+        ratingTarget -= RATING_STEP;
+        updateRequired = true;
+      }
+    } else if (input_.wasReleased(HalGPIO::BTN_CONFIRM)) {
+      if (ratingIndex.isOpen()) {
+        clearTheme();
+        ratingWindowActive = true;
+        loadRandomRatedPuzzle();
+        logEvent("RATING", "window=%u-%u", ratingWindowLow(), ratingWindowHigh());
+        logModeChange(currentMode, Mode::Playing, "rating selected");
+        currentMode = Mode::Playing;
+        updateRequired = true;
+      }
+    } else if (input_.wasReleased(HalGPIO::BTN_BACK)) {
+      logModeChange(currentMode, Mode::PackMenu, "back");
+      currentMode = Mode::PackMenu;
+      updateRequired = true;
+    }
+    return;
+  }
+
   if (currentMode == Mode::Browsing) {
     if (input_.wasPressed(HalGPIO::BTN_UP)) {
       if (browserIndex > 0) {
@@ -298,16 +398,12 @@ void ChessPuzzlesApp::loop() {
     } else if (input_.wasReleased(HalGPIO::BTN_CONFIRM)) {
       switch (static_cast<InGameMenuItem>(inGameMenuIndex)) {
         case InGameMenuItem::Retry:
-          loadPuzzleFromPack(currentPuzzleIndex);
+          restartPuzzle();
           logModeChange(currentMode, Mode::Playing, "retry");
           currentMode = Mode::Playing;
           break;
         case InGameMenuItem::Skip:
-          if (!activeTheme.empty() && !themeBitset.empty()) {
-            loadRandomThemedPuzzle();
-          } else {
-            loadNextPuzzle();
-          }
+          advancePuzzle();
           logModeChange(currentMode, Mode::Playing, "skip");
           currentMode = Mode::Playing;
           break;
@@ -352,13 +448,9 @@ void ChessPuzzlesApp::loop() {
   if (puzzleSolved || puzzleFailed) {
     if (input_.wasReleased(HalGPIO::BTN_CONFIRM)) {
       if (puzzleSolved) {
-        if (!activeTheme.empty() && !themeBitset.empty()) {
-          loadRandomThemedPuzzle();
-        } else {
-          loadNextPuzzle();
-        }
+        advancePuzzle();
       } else {
-        loadPuzzleFromPack(currentPuzzleIndex);
+        restartPuzzle();
       }
       updateRequired = true;
       return;
@@ -488,7 +580,7 @@ void ChessPuzzlesApp::loop() {
           found = false;
 
           for (size_t i = 0; i < legalMovesFromSelected.size(); i++) {
-            const int sq = legalMovesFromSelected[i].to;
+            const int sq = legalMovesFromSelected[i].to();
             if (sq == curSq) continue;
             const int f = Chess::BoardState::fileOf(sq);
             const int r = Chess::BoardState::rankOf(sq);
@@ -528,7 +620,7 @@ void ChessPuzzlesApp::loop() {
           moved = true;
 
           for (size_t i = 0; i < legalMovesFromSelected.size(); i++) {
-            if (legalMovesFromSelected[i].to == bestSq) {
+            if (legalMovesFromSelected[i].to() == bestSq) {
               legalMoveNavIndex = static_cast<int>(i);
               break;
             }
@@ -546,7 +638,7 @@ void ChessPuzzlesApp::loop() {
         deselectPiece();
       } else if (isLegalDestination(sq)) {
         for (const auto& move : legalMovesFromSelected) {
-          if (move.to == sq) {
+          if (move.to() == sq) {
             handlePlayerMove(move);
             break;
           }
@@ -596,6 +688,8 @@ void ChessPuzzlesApp::render() {
     renderPackMenu();
   } else if (currentMode == Mode::ThemeSelect) {
     renderThemeSelect();
+  } else if (currentMode == Mode::RatingSelect) {
+    renderRatingSelect();
   } else if (currentMode == Mode::Browsing) {
     renderBrowser();
   } else if (currentMode == Mode::InGameMenu) {
@@ -686,8 +780,8 @@ void ChessPuzzlesApp::renderHint() {
   };
 
   // From: bracket corners. To: full box.
-  drawBox(m.from, 4, false);
-  drawBox(m.to, 3, true);
+  drawBox(m.from(), 4, false);
+  drawBox(m.to(), 3, true);
 }
 
 void ChessPuzzlesApp::renderInGameMenu() {
@@ -859,8 +953,8 @@ void ChessPuzzlesApp::renderLegalMoveHints() {
   constexpr int dotRadius = 8;
   
   for (const auto& move : legalMovesFromSelected) {
-    int file = Chess::BoardState::fileOf(move.to);
-    int rank = Chess::BoardState::rankOf(move.to);
+    int file = Chess::BoardState::fileOf(move.to());
+    int rank = Chess::BoardState::rankOf(move.to());
     
     int centerX = screenX(file) + SQUARE_SIZE / 2;
     int centerY = screenY(rank) + SQUARE_SIZE / 2;
@@ -868,7 +962,7 @@ void ChessPuzzlesApp::renderLegalMoveHints() {
     bool squareIsLight = (file + rank) % 2 == 1;
     bool dotColor = squareIsLight;
     
-    bool isCapture = board.at(move.to) != Chess::NONE;
+    bool isCapture = move.isCapture();
     
     if (isCapture) {
       for (int dy = -dotRadius; dy <= dotRadius; dy++) {
@@ -909,29 +1003,72 @@ void ChessPuzzlesApp::renderStatus() {
     
     // Keep the status block compact; the blank area is limited.
     {
-      std::string pack = packName.empty() ? "(no pack)" : packName;
+      const std::string packLabel = packName.empty() ? "(no pack)" : packName;
       const int idx = static_cast<int>(currentPuzzleIndex) + 1;
       const int total = static_cast<int>(puzzleCount);
 
       char line2[96];
-      snprintf(line2, sizeof(line2), "%s  %d/%d  r%d", pack.c_str(), idx, total, currentPuzzle.rating);
+      snprintf(line2, sizeof(line2), "%s  %d/%d  r%d", packLabel.c_str(), idx, total, currentPuzzle.rating);
       renderer.drawCenteredText(UI_10_FONT_ID, y + 25, line2);
 
       int infoY = y + 50;
-      if (board.inCheck()) {
-        renderer.drawCenteredText(UI_10_FONT_ID, infoY, "Check!");
+      const char* statusLine = nullptr;
+      switch (boardStatus) {
+        case Chess::GameStatus::Checkmate:
+          statusLine = "Checkmate";
+          break;
+        case Chess::GameStatus::Stalemate:
+          statusLine = "Stalemate";
+          break;
+        case Chess::GameStatus::FiftyMoveRule:
+          statusLine = "Draw (50-move rule)";
+          break;
+        case Chess::GameStatus::InsufficientMaterial:
+          statusLine = "Draw (insufficient material)";
+          break;
+        case Chess::GameStatus::Ongoing:
+          if (board.inCheck()) statusLine = "Check!";
+          break;
+      }
+      if (statusLine) {
+        renderer.drawCenteredText(UI_10_FONT_ID, infoY, statusLine);
         infoY += 20;
       }
 
-      if (!activeTheme.empty()) {
-        std::string prettyTheme = activeTheme;
-        std::replace(prettyTheme.begin(), prettyTheme.end(), '_', ' ');
-        std::string themeLine = "Theme: " + prettyTheme;
+      auto drawInfoLine = [&](std::string line) {
+        std::replace(line.begin(), line.end(), '_', ' ');
         const int maxW = renderer.getScreenWidth() - 20;
-        if (renderer.getTextWidth(UI_10_FONT_ID, themeLine.c_str()) > maxW) {
-          themeLine = renderer.truncatedText(UI_10_FONT_ID, themeLine.c_str(), maxW);
+        if (renderer.getTextWidth(UI_10_FONT_ID, line.c_str()) > maxW) {
+          line = renderer.truncatedText(UI_10_FONT_ID, line.c_str(), maxW);
+        }
+        renderer.drawCenteredText(UI_10_FONT_ID, infoY, line.c_str());
+        infoY += 20;
+      };
+
+      if (!activeTheme.empty() || queryActive) {
+        drawInfoLine((queryActive ? "Query: " : "Theme: ") + (queryActive ? queryLabel : activeTheme));
+      }
+
+      // The puzzle's own themes and opening, from the pack string table
+      const Chess::PackStrings& strings = pack.strings();
+      std::string puzzleThemes;
+      for (int bit = 0; bit < strings.themeCount(); bit++) {
+        if (currentPuzzle.themeMask & (Chess::ThemeMask(1) << bit)) {
+          puzzleThemes += (puzzleThemes.empty() ? "" : ", ") + std::string(strings.theme(bit));
         }
-        renderer.drawCenteredText(UI_10_FONT_ID, infoY, themeLine.c_str());
+      }
+      if (!puzzleThemes.empty()) {
+        drawInfoLine(puzzleThemes);
+      }
+      const std::string_view opening = strings.opening(currentPuzzle.openingId);
+      if (!opening.empty()) {
+        drawInfoLine("Opening: " + std::string(opening));
+      }
+
+      if (ratingWindowActive) {
+        char ratingLine[40];
+        snprintf(ratingLine, sizeof(ratingLine), "Rating %u-%u", ratingWindowLow(), ratingWindowHigh());
+        renderer.drawCenteredText(UI_10_FONT_ID, infoY, ratingLine);
         infoY += 20;
       }
 
@@ -1023,68 +1160,64 @@ void ChessPuzzlesApp::renderPackSelect() {
 }
 
 bool ChessPuzzlesApp::loadPackInfo() {
-  FsFile file;
-  if (!SdMan.openFileForRead("CHESS", packPath, file)) {
-    Serial.println("[CHESS] Failed to open pack file");
-    return false;
-  }
-  
-  uint8_t header[Chess::PACK_HEADER_SIZE];
-  if (file.read(header, Chess::PACK_HEADER_SIZE) != Chess::PACK_HEADER_SIZE) {
-    file.close();
-    Serial.println("[CHESS] Failed to read pack header");
-    return false;
-  }
-  file.close();
-  
-  Chess::PackHeader packHeader;
-  if (!Chess::PackHeader::fromFile(header, packHeader)) {
-    Serial.println("[CHESS] Invalid pack magic");
+  if (!pack.open(packPath)) {
     return false;
   }
   
+  const Chess::PackHeader& packHeader = pack.header();
   puzzleCount = packHeader.puzzleCount;
-  // Allow pack files to evolve record size while keeping backward compatibility.
-  packRecordSize = packHeader.recordSize;
-  if (packRecordSize < Chess::RECORD_SIZE || packRecordSize > 1024) {
-    Serial.printf("[CHESS] Invalid record size %d; using default %d\n", packRecordSize, Chess::RECORD_SIZE);
-    packRecordSize = Chess::RECORD_SIZE;
-  }
-  Serial.printf("[CHESS] Loaded pack with %d puzzles (rating %d-%d)\n", 
-                puzzleCount, packHeader.ratingMin, packHeader.ratingMax);
+  prefetch = PrefetchState::Empty;
+
+  // Optional; the rating menu explains how to add one when it is missing
+  ratingWindowActive = false;
+  if (ratingIndex.open(getRatingIndexPath(), puzzleCount)) {
+    const uint16_t mid = (ratingIndex.ratingMin() + ratingIndex.ratingMax()) / 2;
+    ratingTarget = mid - mid % RATING_STEP;
+  }
+  Serial.printf("[CHESS] Loaded CPZ%d pack with %d puzzles (rating %d-%d)\n", 
+                packHeader.version, puzzleCount, packHeader.ratingMin, packHeader.ratingMax);
   return true;
 }
 
-bool ChessPuzzlesApp::loadPuzzleFromPack(uint32_t index) {
+bool ChessPuzzlesApp::readPackRecord(uint32_t index, uint8_t* record) {
+  // Reading a CPZ1 record can add to the pack strings renderStatus() draws
+  // on the display task, so no frame may be drawn meanwhile
+  xSemaphoreTake(renderingMutex, portMAX_DELAY);
+  const bool ok = pack.readRecord(index, record);
+  xSemaphoreGive(renderingMutex);
+  return ok;
+}
+
+bool ChessPuzzlesApp::readPuzzle(uint32_t index, Chess::Puzzle& out) {
   if (index >= puzzleCount) {
     return false;
   }
   
-  FsFile file;
-  if (!SdMan.openFileForRead("CHESS", packPath, file)) {
-    return false;
-  }
-  
-  uint32_t offset = Chess::PACK_HEADER_SIZE + index * packRecordSize;
-  if (!file.seek(offset)) {
-    file.close();
+  uint8_t record[Chess::MAX_RECORD_SIZE];
+  if (!readPackRecord(index, record)) {
     return false;
   }
   
-  std::vector<uint8_t> record;
-  record.resize(packRecordSize);
-  if (file.read(record.data(), packRecordSize) != packRecordSize) {
-    file.close();
+  out = Chess::PuzzleView(record, pack.recordSize()).toPuzzle();
+  return true;
+}
+
+bool ChessPuzzlesApp::loadPuzzleFromPack(uint32_t index) {
+  if (!readPuzzle(index, currentPuzzle)) {
     return false;
   }
-  file.close();
-  
-  currentPuzzle = Chess::Puzzle::fromRecord(record.data(), packRecordSize);
+  startPuzzle(index);
+  return true;
+}
+
+void ChessPuzzlesApp::startPuzzle(uint32_t index) {
   currentPuzzleIndex = index;
   
   board = currentPuzzle.position;
+  boardStatus = board.gameStatus();
   playerIsWhite = board.whiteToMove;
   currentMoveIndex = 0;
+  moveHistoryCount = 0;
   puzzleSolved = false;
   puzzleFailed = false;
   hintActive = false;
@@ -1092,10 +1225,11 @@ bool ChessPuzzlesApp::loadPuzzleFromPack(uint32_t index) {
   pendingFullRefresh = false;
 
   deselectPiece();
+  // The next candidate depends on which puzzle is current
+  prefetch = PrefetchState::Empty;
   
   Serial.printf("[CHESS] Loaded puzzle %d, rating %d, %d moves\n",
                 index, currentPuzzle.rating, currentPuzzle.solution.size());
-  return true;
 }
 
 void ChessPuzzlesApp::loadNextPuzzle() {
@@ -1105,6 +1239,69 @@ void ChessPuzzlesApp::loadNextPuzzle() {
   }
 }
 
+void ChessPuzzlesApp::advancePuzzle() {
+  if (prefetch == PrefetchState::Ready) {
+    // A query prefetch only peeked at the cursor; move it past the puzzle now
+    uint32_t index = prefetchIndex;
+    if (queryActive && (!themeQuery.next(index) || index != prefetchIndex)) {
+      prefetch = PrefetchState::Empty;
+      if (!loadPuzzleFromPack(index)) {
+        loadRandomPuzzle();
+      }
+      return;
+    }
+    std::swap(currentPuzzle, prefetchedPuzzle);
+    startPuzzle(index);
+    logEvent("PREFETCH", "used index=%lu", static_cast<unsigned long>(index));
+    return;
+  }
+  
+  if (queryActive) {
+    loadNextQueryPuzzle();
+  } else if (ratingWindowActive) {
+    loadRandomRatedPuzzle();
+  } else if (!activeTheme.empty()) {
+    loadRandomThemedPuzzle();
+  } else {
+    loadNextPuzzle();
+  }
+}
+
+// Idle step: read and decode the puzzle advancePuzzle() would load, so Next
+// and Skip do not wait for the SD card. Picks with the same rules, treating
+// the current puzzle as already solved.
+void ChessPuzzlesApp::prefetchNextPuzzle() {
+  if (prefetch != PrefetchState::Empty || puzzleCount == 0 || !pack.isOpen()) {
+    return;
+  }
+  
+  uint32_t index = (currentPuzzleIndex + 1) % puzzleCount;
+  bool picked = true;
+  if (queryActive) {
+    picked = pickQueryIndex(index, false);
+  } else if (ratingWindowActive) {
+    picked = pickRatedIndex(index);
+  } else if (!activeTheme.empty()) {
+    picked = pickThemedIndex(index);
+  }
+  if (!picked) {
+    // Nothing matches; advancePuzzle() falls back to a random puzzle
+    prefetch = PrefetchState::Failed;
+    return;
+  }
+  
+  const uint32_t startMs = millis();
+  if (!readPuzzle(index, prefetchedPuzzle)) {
+    prefetch = PrefetchState::Failed;
+    logEvent("PREFETCH", "failed index=%lu", static_cast<unsigned long>(index));
+    return;
+  }
+  prefetchIndex = index;
+  prefetch = PrefetchState::Ready;
+  logEvent("PREFETCH", "ready index=%lu ms=%lu", static_cast<unsigned long>(index),
+           static_cast<unsigned long>(millis() - startMs));
+}
+
 void ChessPuzzlesApp::loadDemoPuzzle() {
   for (int i = 0; i < 64; i++) {
     board.set(i, Chess::NONE);
@@ -1135,14 +1332,15 @@ void ChessPuzzlesApp::loadDemoPuzzle() {
   board.whiteToMove = true;
   board.castling = 0;
   board.epSquare = -1;
+  board.rebuildDerivedState();
   
   playerIsWhite = true;
   
   currentPuzzle.rating = 1200;
   currentPuzzle.position = board;
   currentPuzzle.solution.clear();
-  currentPuzzle.themes.clear();
-  currentPuzzle.opening.clear();
+  currentPuzzle.themeMask = 0;
+  currentPuzzle.openingId = 0;
   currentPuzzle.solution.push_back(Chess::Move(
     Chess::BoardState::makeSquare(5, 2),
     Chess::BoardState::makeSquare(4, 4)
@@ -1150,7 +1348,9 @@ void ChessPuzzlesApp::loadDemoPuzzle() {
   
   puzzleCount = 1;
   currentPuzzleIndex = 0;
+  prefetch = PrefetchState::Empty;
   currentMoveIndex = 0;
+  moveHistoryCount = 0;
   puzzleSolved = false;
   puzzleFailed = false;
   hintActive = false;
@@ -1160,6 +1360,25 @@ void ChessPuzzlesApp::loadDemoPuzzle() {
   deselectPiece();
 }
 
+void ChessPuzzlesApp::restartPuzzle() {
+  // Take moves back instead of re-reading the record from SD.
+  while (moveHistoryCount > 0) {
+    board.unmakeMove(moveHistory[--moveHistoryCount]);
+  }
+  boardStatus = board.gameStatus();
+
+  currentMoveIndex = 0;
+  puzzleSolved = false;
+  puzzleFailed = false;
+  hintActive = false;
+  movesSinceFullRefresh = 0;
+  pendingFullRefresh = false;
+
+  deselectPiece();
+
+  logEvent("PUZZLE", "restart index=%lu", static_cast<unsigned long>(currentPuzzleIndex));
+}
+
 void ChessPuzzlesApp::selectSquare(int sq) {
   Chess::Piece piece = board.at(sq);
 
@@ -1176,7 +1395,7 @@ void ChessPuzzlesApp::selectSquare(int sq) {
 
   pieceSelected = true;
   selectedSquare = sq;
-  legalMovesFromSelected = board.generateLegalMovesFrom(sq);
+  board.generateLegalMovesFrom(sq, legalMovesFromSelected);
   legalMoveNavIndex = 0;
 }
 
@@ -1188,11 +1407,12 @@ void ChessPuzzlesApp::deselectPiece() {
 }
 
 bool ChessPuzzlesApp::tryMove(const Chess::Move& move) {
-  if (!board.isLegalMove(move)) {
+  if (moveHistoryCount >= Chess::MAX_SOLUTION_MOVES || !board.isLegalMove(move)) {
     return false;
   }
   
-  board = board.applyMove(move);
+  board.makeMove(move, moveHistory[moveHistoryCount++]);
+  boardStatus = board.gameStatus();
   return true;
 }
 
@@ -1201,29 +1421,38 @@ void ChessPuzzlesApp::handlePlayerMove(const Chess::Move& move) {
   hintActive = false;
 
   if (currentMoveIndex >= static_cast<int>(currentPuzzle.solution.size())) {
-    logEvent("MOVE", "attempt=%d->%d unexpected=end_of_solution", move.from, move.to);
+    logEvent("MOVE", "attempt=%d->%d unexpected=end_of_solution", move.from(), move.to());
     onPuzzleFailed();
     return;
   }
   
   const Chess::Move& expectedMove = currentPuzzle.solution[currentMoveIndex];
 
-  if (move.from != expectedMove.from || move.to != expectedMove.to) {
-    logEvent("MOVE", "attempt=%d->%d expected=%d->%d result=mismatch", move.from, move.to,
-             expectedMove.from, expectedMove.to);
+  if (move.from() != expectedMove.from() || move.to() != expectedMove.to()) {
+    if (acceptsAlternativeMove(move, expectedMove) && tryMove(move)) {
+      // The book line no longer applies, so an accepted alternative ends the puzzle.
+      logEvent("MOVE", "attempt=%d->%d expected=%d->%d result=alternate", move.from(), move.to(),
+               expectedMove.from(), expectedMove.to());
+      deselectPiece();
+      logEvent("PUZZLE", "solved=1 index=%lu alternate=1", static_cast<unsigned long>(currentPuzzleIndex));
+      onPuzzleSolved();
+      return;
+    }
+    logEvent("MOVE", "attempt=%d->%d expected=%d->%d result=mismatch", move.from(), move.to(),
+             expectedMove.from(), expectedMove.to());
     onPuzzleFailed();
     return;
   }
 
   if (!tryMove(move)) {
-    logEvent("MOVE", "attempt=%d->%d expected=%d->%d result=illegal", move.from, move.to,
-             expectedMove.from, expectedMove.to);
+    logEvent("MOVE", "attempt=%d->%d expected=%d->%d result=illegal", move.from(), move.to(),
+             expectedMove.from(), expectedMove.to());
     onPuzzleFailed();
     return;
   }
 
-  logEvent("MOVE", "attempt=%d->%d expected=%d->%d result=ok", move.from, move.to,
-           expectedMove.from, expectedMove.to);
+  logEvent("MOVE", "attempt=%d->%d expected=%d->%d result=ok", move.from(), move.to(),
+           expectedMove.from(), expectedMove.to());
   
   deselectPiece();
   currentMoveIndex++;
@@ -1243,6 +1472,81 @@ void ChessPuzzlesApp::handlePlayerMove(const Chess::Move& move) {
   playOpponentMove();
 }
 
+bool ChessPuzzlesApp::acceptsAlternativeMove(const Chess::Move& move, const Chess::Move& expected) {
+  if (!board.isLegalMove(move) || !board.isLegalMove(expected)) {
+    return false;
+  }
+  if (board.applyMove(move).isCheckmate()) {
+    return true;
+  }
+
+  // The mate solver and both searches share one deadline. Each call gets its
+  // share of what is left, so an early one cannot starve the later ones.
+  const uint32_t startMs = millis();
+  Chess::SearchLimits limits;
+  limits.maxNodes = ALT_SEARCH_NODES;
+  auto timeLeft = [&](uint32_t callsLeft) {
+    const uint32_t elapsed = millis() - startMs;
+    limits.maxTimeMs = elapsed < ALT_SEARCH_MS ? (ALT_SEARCH_MS - elapsed) / callsLeft : 0;
+    return limits.maxTimeMs > 0;
+  };
+
+  // Mating puzzles: the checks-only solver settles most alternatives in a
+  // few hundred nodes. Quiet mating moves fall through to the full search.
+  const int mateMoves = remainingMateMoves();
+  if (mateMoves > 0) {
+    timeLeft(3);
+    Chess::MoveList mates;
+    const Chess::MateResult mate = engine.findMates(board, mateMoves, limits, mates);
+    logEvent("ENGINE", "mate_in=%d found=%d shortest=%d nodes=%lu ms=%lu", mateMoves, mates.count, mate.mateIn,
+             static_cast<unsigned long>(mate.nodes), static_cast<unsigned long>(mate.timeMs));
+    if (mates.contains(move)) {
+      return true;
+    }
+  }
+
+  if (!timeLeft(2)) {
+    return false;
+  }
+  const Chess::SearchResult alt = engine.scoreMove(board, move, limits);
+  if (alt.score >= Chess::MATE_BOUND) {
+    logEvent("ENGINE", "alternate mates score=%d depth=%d nodes=%lu ms=%lu", alt.score, alt.depth,
+             static_cast<unsigned long>(alt.nodes), static_cast<unsigned long>(alt.timeMs));
+    return true;
+  }
+
+  if (!timeLeft(1)) {
+    logEvent("ENGINE", "alternate=%d book=unscored depth=%d", alt.score, alt.depth);
+    return false;
+  }
+  const Chess::SearchResult book = engine.scoreMove(board, expected, limits);
+  const Chess::TTStats& tt = engine.table().stats();
+  logEvent("ENGINE", "alternate=%d book=%d depth=%d/%d nodes=%lu ms=%lu tt_hit=%lu tt_miss=%lu tt_repl=%lu",
+           alt.score, book.score, alt.depth, book.depth, static_cast<unsigned long>(alt.nodes + book.nodes),
+           static_cast<unsigned long>(alt.timeMs + book.timeMs), static_cast<unsigned long>(tt.hits),
+           static_cast<unsigned long>(tt.misses), static_cast<unsigned long>(tt.replacements));
+
+  // A mating puzzle needs a mating move; otherwise the alternative has to keep
+  // a clear win that is not much worse than the book move.
+  if (book.score >= Chess::MATE_BOUND) {
+    return false;
+  }
+  return alt.score >= ALT_WIN_SCORE && alt.score >= book.score - ALT_MAX_LOSS;
+}
+
+int ChessPuzzlesApp::remainingMateMoves() const {
+  // Replay the rest of the book line; if it ends in mate, that is how many
+  // moves the player has left to deliver it.
+  Chess::BoardState pos = board;
+  const int total = static_cast<int>(currentPuzzle.solution.size());
+  for (int i = currentMoveIndex; i < total; i++) {
+    if (!pos.isLegalMove(currentPuzzle.solution[i])) return 0;
+    pos = pos.applyMove(currentPuzzle.solution[i]);
+  }
+  if (!pos.isCheckmate()) return 0;
+  return (total - currentMoveIndex + 1) / 2;
+}
+
 void ChessPuzzlesApp::playOpponentMove() {
   if (currentMoveIndex >= static_cast<int>(currentPuzzle.solution.size())) {
     return;
@@ -1289,7 +1593,7 @@ int ChessPuzzlesApp::screenY(int rank) const {
 
 bool ChessPuzzlesApp::isLegalDestination(int sq) const {
   for (const auto& move : legalMovesFromSelected) {
-    if (move.to == sq) return true;
+    if (move.to() == sq) return true;
   }
   return false;
 }
@@ -1408,7 +1712,7 @@ void ChessPuzzlesApp::renderPackMenu() {
   constexpr int lineHeight = 38;
   constexpr int menuWidth = 200;
   
-  const char* menuItems[] = { "Continue", "Random Puzzle", "By Theme", "Browse All" };
+  const char* menuItems[] = { "Continue", "Random Puzzle", "By Theme", "By Rating", "Browse All" };
   int screenWidth = renderer.getScreenWidth();
   int menuX = (screenWidth - menuWidth) / 2;
   
@@ -1480,12 +1784,15 @@ std::string ChessPuzzlesApp::getSolvedPath() const {
 }
 
 void ChessPuzzlesApp::loadSolvedBitset() {
-  solvedBitset.clear();
+  // Both depend on the bitset about to be replaced
+  unsolvedIndex.clear();
+  clearTheme();
+  solvedBitset.reset();
   
   if (puzzleCount == 0) return;
   
-  size_t bitsetSize = (puzzleCount + 7) / 8;
-  solvedBitset.resize(bitsetSize, 0);
+  solvedBitset.resize(puzzleCount);
+  const size_t bitsetSize = solvedBitset.byteSize();
   
   FsFile file;
   std::string solvedPath = getSolvedPath();
@@ -1494,13 +1801,14 @@ void ChessPuzzlesApp::loadSolvedBitset() {
     return;
   }
   
-  size_t bytesRead = file.read(solvedBitset.data(), bitsetSize);
+  size_t bytesRead = file.read(solvedBitset.bytes(), bitsetSize);
   file.close();
   
   if (bytesRead != bitsetSize) {
     Serial.printf("[CHESS] Solved bitset size mismatch, resetting\n");
-    std::fill(solvedBitset.begin(), solvedBitset.end(), 0);
+    solvedBitset.clearAll();
   } else {
+    solvedBitset.trim();
     Serial.printf("[CHESS] Loaded solved bitset (%d bytes)\n", bytesRead);
   }
 }
@@ -1517,29 +1825,33 @@ void ChessPuzzlesApp::saveSolvedBitset() {
     return;
   }
   
-  file.write(solvedBitset.data(), solvedBitset.size());
+  file.write(solvedBitset.bytes(), solvedBitset.byteSize());
   file.close();
   
-  Serial.printf("[CHESS] Saved solved bitset (%d bytes)\n", solvedBitset.size());
+  Serial.printf("[CHESS] Saved solved bitset (%d bytes)\n", solvedBitset.byteSize());
 }
 
 void ChessPuzzlesApp::markPuzzleSolved(uint32_t index) {
-  if (index / 8 >= solvedBitset.size()) return;
-  solvedBitset[index / 8] |= (1 << (index % 8));
+  if (index >= solvedBitset.size() || solvedBitset.test(index)) return;
+  
+  // Ask before the bit is set; a chunk loaded afterwards already leaves it out
+  if (themeBitmap.isOpen() && isThemeUnsolved(index)) {
+    themeChunk.clear(index % ThemeBitmap::CHUNK_BITS);
+    themeChunkIndex.remove(index % ThemeBitmap::CHUNK_BITS);
+    themeChunkUnsolved[index / ThemeBitmap::CHUNK_BITS]--;
+    themeUnsolved--;
+  }
+  solvedBitset.set(index);
+  unsolvedIndex.remove(index);
 }
 
 bool ChessPuzzlesApp::isPuzzleSolved(uint32_t index) const {
-  if (index / 8 >= solvedBitset.size()) return false;
-  return (solvedBitset[index / 8] >> (index % 8)) & 1;
+  return solvedBitset.test(index);
 }
 
 void ChessPuzzlesApp::countSolvedPuzzles() {
-  solvedCount = 0;
-  for (uint32_t i = 0; i < puzzleCount; i++) {
-    if (isPuzzleSolved(i)) {
-      solvedCount++;
-    }
-  }
+  unsolvedIndex.build(nullptr, solvedBitset.empty() ? nullptr : &solvedBitset, puzzleCount);
+  solvedCount = solvedBitset.count();
   Serial.printf("[CHESS] Solved count: %d/%d\n", solvedCount, puzzleCount);
 }
 
@@ -1549,35 +1861,20 @@ void ChessPuzzlesApp::loadRandomPuzzle() {
     return;
   }
   
-  uint32_t unsolvedCount = puzzleCount - solvedCount;
-  if (unsolvedCount == 0) {
-    uint32_t randomIndex = esp_random() % puzzleCount;
-    if (!loadPuzzleFromPack(randomIndex)) {
-      loadDemoPuzzle();
-    }
-    return;
+  // Any puzzle once all are solved
+  uint32_t index = esp_random() % puzzleCount;
+  if (!unsolvedIndex.empty()) {
+    unsolvedIndex.select(esp_random() % unsolvedIndex.count(), index);
   }
   
-  uint32_t targetUnsolved = esp_random() % unsolvedCount;
-  uint32_t unseenCount = 0;
-  
-  for (uint32_t i = 0; i < puzzleCount; i++) {
-    if (!isPuzzleSolved(i)) {
-      if (unseenCount == targetUnsolved) {
-        if (loadPuzzleFromPack(i)) {
-          return;
-        }
-        break;
-      }
-      unseenCount++;
-    }
+  if (index >= puzzleCount || !loadPuzzleFromPack(index)) {
+    loadDemoPuzzle();
   }
-  
-  loadDemoPuzzle();
 }
 
 void ChessPuzzlesApp::loadAvailableThemes() {
   availableThemes.clear();
+  themeToggles.clear();
   
   std::string indexDir = "/.crosspoint/chess/index/" + packName;
   auto dir = SdMan.open(indexDir.c_str());
@@ -1598,8 +1895,8 @@ void ChessPuzzlesApp::loadAvailableThemes() {
     }
     
     std::string filename(name);
-    if (filename.size() > 4 && filename.substr(0, 6) == "theme_" && 
-        filename.substr(filename.size() - 4) == ".bit") {
+    if (filename.size() > 10 && filename.substr(0, 6) == "theme_" && 
+        (filename.substr(filename.size() - 4) == ".bit" || filename.substr(filename.size() - 4) == ".rbm")) {
       std::string themeName = filename.substr(6, filename.size() - 10);
       availableThemes.push_back(themeName);
     }
@@ -1607,94 +1904,342 @@ void ChessPuzzlesApp::loadAvailableThemes() {
   }
   dir.close();
   
+  // A theme may have both a .rbm and a .bit file
   std::sort(availableThemes.begin(), availableThemes.end());
+  availableThemes.erase(std::unique(availableThemes.begin(), availableThemes.end()), availableThemes.end());
+  themeToggles.assign(availableThemes.size(), ThemeToggle::Off);
   Serial.printf("[CHESS] Found %d themes for pack %s\n", availableThemes.size(), packName.c_str());
 }
 
-void ChessPuzzlesApp::loadThemeBitset(const std::string& theme) {
-  themeBitset.clear();
+// Count the theme's puzzles, solved or not, chunk by chunk; only one
+// decoded chunk is held at a time.
+void ChessPuzzlesApp::loadThemeBitmap(const std::string& theme) {
+  themeBitmap.close();
+  themeChunkTotal.clear();
+  themeChunkUnsolved.clear();
+  themeTotal = 0;
+  themeUnsolved = 0;
+  themeChunkIndex.clear();
+  themeChunkLoaded = NO_CHUNK;
   
   if (puzzleCount == 0) return;
   
-  size_t bitsetSize = (puzzleCount + 7) / 8;
-  themeBitset.resize(bitsetSize, 0);
-  
-  std::string themePath = "/.crosspoint/chess/index/" + packName + "/theme_" + theme + ".bit";
-  
-  FsFile file;
-  if (!SdMan.openFileForRead("CHESS", themePath, file)) {
-    Serial.printf("[CHESS] Failed to load theme bitset from %s\n", themePath.c_str());
-    themeBitset.clear();
+  const std::string basePath = "/.crosspoint/chess/index/" + packName + "/theme_" + theme;
+  if (!themeBitmap.open(basePath, puzzleCount)) {
     return;
   }
   
-  size_t bytesRead = file.read(themeBitset.data(), bitsetSize);
-  file.close();
+  const uint32_t startMs = millis();
+  const uint32_t chunks = themeBitmap.chunkCount();
+  themeChunkTotal.assign(chunks, 0);
+  themeChunkUnsolved.assign(chunks, 0);
+  for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+    if (!themeBitmap.readChunk(chunk, themeChunk)) {
+      Serial.printf("[CHESS] Failed to read theme %s chunk %d\n", theme.c_str(), chunk);
+      themeBitmap.close();
+      themeChunkTotal.clear();
+      themeChunkUnsolved.clear();
+      themeTotal = 0;
+      themeUnsolved = 0;
+      themeChunk.reset();
+      return;
+    }
+    themeChunkTotal[chunk] = themeChunk.count();
+    themeChunkUnsolved[chunk] = solvedBitset.empty()
+                                    ? themeChunkTotal[chunk]
+                                    : themeChunk.countAndNot(solvedBitset, chunk * ThemeBitmap::CHUNK_WORDS);
+    themeTotal += themeChunkTotal[chunk];
+    themeUnsolved += themeChunkUnsolved[chunk];
+  }
   
-  if (bytesRead != bitsetSize) {
-    Serial.printf("[CHESS] Theme bitset size mismatch\n");
-    themeBitset.clear();
-  } else {
-    Serial.printf("[CHESS] Loaded theme %s bitset (%d bytes)\n", theme.c_str(), bytesRead);
+  logEvent("THEME", "puzzles=%lu unsolved=%lu chunks=%lu %s ms=%lu", static_cast<unsigned long>(themeTotal),
+           static_cast<unsigned long>(themeUnsolved), static_cast<unsigned long>(chunks),
+           themeBitmap.compressed() ? "rbm" : "bit", static_cast<unsigned long>(millis() - startMs));
+}
+
+// Decode a chunk into themeChunk, leaving out solved puzzles
+bool ChessPuzzlesApp::loadThemeChunk(uint32_t chunk) {
+  if (chunk == themeChunkLoaded) return true;
+  
+  themeChunkLoaded = NO_CHUNK;
+  if (!themeBitmap.readChunk(chunk, themeChunk)) {
+    themeChunkIndex.clear();
+    return false;
   }
+  if (!solvedBitset.empty()) {
+    themeChunk.andNot(solvedBitset, chunk * ThemeBitmap::CHUNK_WORDS);
+  }
+  themeChunkIndex.build(&themeChunk, nullptr, themeChunk.size());
+  themeChunkLoaded = chunk;
+  return true;
 }
 
-bool ChessPuzzlesApp::puzzleMatchesTheme(uint32_t index) const {
-  if (themeBitset.empty()) return true;
-  if (index / 8 >= themeBitset.size()) return false;
-  return (themeBitset[index / 8] >> (index % 8)) & 1;
+bool ChessPuzzlesApp::isThemeUnsolved(uint32_t index) {
+  if (index >= puzzleCount || !loadThemeChunk(index / ThemeBitmap::CHUNK_BITS)) return false;
+  return themeChunkIndex.contains(index % ThemeBitmap::CHUNK_BITS);
 }
 
-void ChessPuzzlesApp::loadRandomThemedPuzzle() {
-  if (puzzleCount == 0 || themeBitset.empty()) {
-    loadRandomPuzzle();
+void ChessPuzzlesApp::clearTheme() {
+  activeTheme.clear();
+  themeBitmap.close();
+  themeChunkTotal.clear();
+  themeChunkUnsolved.clear();
+  themeTotal = 0;
+  themeUnsolved = 0;
+  themeChunk.reset();
+  themeChunkIndex.clear();
+  themeChunkLoaded = NO_CHUNK;
+  queryActive = false;
+  queryLabel.clear();
+  themeQuery.clear();
+}
+
+// Random puzzle with the active theme, preferring unsolved ones. The current
+// puzzle counts as solved, so a pick made while it is still being played
+// matches what a pick after solving it would choose from. Reads at most the
+// current puzzle's chunk and the chosen one.
+bool ChessPuzzlesApp::pickThemedIndex(uint32_t& index) {
+  if (puzzleCount == 0) return false;
+  if (!themeBitmap.isOpen()) return scanThemedIndex(index);
+  
+  const uint32_t chunks = themeBitmap.chunkCount();
+  const bool skipCurrent = isThemeUnsolved(currentPuzzleIndex);
+  const uint32_t currentChunk = currentPuzzleIndex / ThemeBitmap::CHUNK_BITS;
+  const uint32_t unsolvedCount = themeUnsolved - (skipCurrent ? 1 : 0);
+  if (unsolvedCount > 0) {
+    uint32_t k = esp_random() % unsolvedCount;
+    uint32_t chunk = 0;
+    for (; chunk < chunks; chunk++) {
+      const uint32_t inChunk = themeChunkUnsolved[chunk] - (skipCurrent && chunk == currentChunk ? 1 : 0);
+      if (k < inChunk) break;
+      k -= inChunk;
+    }
+    if (!loadThemeChunk(chunk)) return false;
+    
+    const uint32_t first = chunk * ThemeBitmap::CHUNK_BITS;
+    if (skipCurrent && chunk == currentChunk && k >= themeChunkIndex.rank(currentPuzzleIndex - first)) k++;
+    uint32_t offset = 0;
+    if (!themeChunkIndex.select(k, offset)) return false;
+    index = first + offset;
+    return true;
+  }
+  
+  // All solved: any puzzle with the theme. The chunk is read whole, so it
+  // does not stay cached as an unsolved chunk.
+  if (themeTotal == 0) return false;
+  uint32_t k = esp_random() % themeTotal;
+  uint32_t chunk = 0;
+  for (; chunk < chunks && k >= themeChunkTotal[chunk]; chunk++) {
+    k -= themeChunkTotal[chunk];
+  }
+  themeChunkLoaded = NO_CHUNK;
+  if (!themeBitmap.readChunk(chunk, themeChunk)) return false;
+  themeChunkIndex.build(&themeChunk, nullptr, themeChunk.size());
+  
+  uint32_t offset = 0;
+  if (!themeChunkIndex.select(k, offset)) return false;
+  index = chunk * ThemeBitmap::CHUNK_BITS + offset;
+  return true;
+}
+
+// Without a usable index file for the theme, match records by their theme
+// mask, reading forward from the current puzzle: the first unsolved match
+// within THEME_SCAN_LIMIT records, else the first solved one.
+bool ChessPuzzlesApp::scanThemedIndex(uint32_t& index) {
+  if (puzzleCount < 2) return false;
+  
+  const uint32_t startMs = millis();
+  const uint32_t limit = std::min(puzzleCount - 1, THEME_SCAN_LIMIT);
+  uint8_t record[Chess::MAX_RECORD_SIZE];
+  Chess::ThemeMask mask = 0;
+  bool haveSolved = false;
+  uint32_t solvedMatch = 0;
+  for (uint32_t step = 1; step <= limit; step++) {
+    const uint32_t candidate = (currentPuzzleIndex + step) % puzzleCount;
+    if (!readPackRecord(candidate, record)) return false;
+    // CPZ1 theme names get their bit when a record first uses them
+    if (mask == 0) mask = pack.strings().themeBit(activeTheme);
+    if (!Chess::PuzzleView(record, pack.recordSize()).hasAnyTheme(mask)) continue;
+    if (solvedBitset.empty() || !solvedBitset.test(candidate)) {
+      index = candidate;
+      logEvent("THEME", "scanned=%lu picked=%lu ms=%lu", static_cast<unsigned long>(step),
+               static_cast<unsigned long>(index), static_cast<unsigned long>(millis() - startMs));
+      return true;
+    }
+    if (!haveSolved) {
+      solvedMatch = candidate;
+      haveSolved = true;
+    }
+  }
+  if (haveSolved) {
+    index = solvedMatch;
+  }
+  return haveSolved;
+}
+
+void ChessPuzzlesApp::toggleThemeRow(int row, int direction) {
+  if (row == 0) {
+    queryUnsolvedOnly = !queryUnsolvedOnly;
     return;
   }
-  
-  uint32_t matchingCount = 0;
-  for (uint32_t i = 0; i < puzzleCount; i++) {
-    if (puzzleMatchesTheme(i) && !isPuzzleSolved(i)) {
-      matchingCount++;
-    }
+  if (row == 1) {
+    queryRatingWindow = ratingIndex.isOpen() && !queryRatingWindow;
+    return;
   }
   
-  if (matchingCount == 0) {
-    for (uint32_t i = 0; i < puzzleCount; i++) {
-      if (puzzleMatchesTheme(i)) {
-        matchingCount++;
-      }
-    }
-    
-    if (matchingCount == 0) {
-      loadRandomPuzzle();
-      return;
-    }
+  const size_t theme = static_cast<size_t>(row - THEME_OPTION_ROWS);
+  if (theme >= themeToggles.size()) return;
+  ThemeToggle& toggle = themeToggles[theme];
+  const int toggled = static_cast<int>(std::count_if(themeToggles.begin(), themeToggles.end(),
+                                                     [](ThemeToggle t) { return t != ThemeToggle::Off; }));
+  if (toggle == ThemeToggle::Off && toggled >= ThemeQuery::MAX_TERMS) return;
+  // Off -> And -> Or -> Not -> Off, or the other way round
+  toggle = static_cast<ThemeToggle>((static_cast<int>(toggle) + (direction > 0 ? 1 : 3)) % 4);
+}
+
+// Combine the toggled themes (or just the highlighted one) with the option
+// rows into themeQuery, and start its cursor at a random puzzle
+void ChessPuzzlesApp::startThemeQuery(int highlightedTheme) {
+  clearTheme();
+  ratingWindowActive = false;
+  themeQuery.clear(puzzleCount);
+  
+  const std::string basePath = "/.crosspoint/chess/index/" + packName + "/theme_";
+  std::string andPart, orPart, notPart;
+  const bool anyToggled = std::any_of(themeToggles.begin(), themeToggles.end(),
+                                      [](ThemeToggle t) { return t != ThemeToggle::Off; });
+  for (size_t i = 0; i < availableThemes.size(); i++) {
+    ThemeToggle toggle = i < themeToggles.size() ? themeToggles[i] : ThemeToggle::Off;
+    if (!anyToggled && static_cast<int>(i) == highlightedTheme) toggle = ThemeToggle::And;
+    if (toggle == ThemeToggle::Off) continue;
     
-    uint32_t target = esp_random() % matchingCount;
-    uint32_t count = 0;
-    for (uint32_t i = 0; i < puzzleCount; i++) {
-      if (puzzleMatchesTheme(i)) {
-        if (count == target) {
-          loadPuzzleFromPack(i);
-          return;
-        }
-        count++;
-      }
+    const std::string& theme = availableThemes[i];
+    ThemeQuery::Op op = ThemeQuery::Op::And;
+    std::string* part = &andPart;
+    const char* separator = " & ";
+    if (toggle == ThemeToggle::Or) {
+      op = ThemeQuery::Op::Or;
+      part = &orPart;
+      separator = " | ";
+    } else if (toggle == ThemeToggle::Not) {
+      op = ThemeQuery::Op::Not;
+      part = &notPart;
+      separator = " -";
     }
-  } else {
-    uint32_t target = esp_random() % matchingCount;
-    uint32_t count = 0;
-    for (uint32_t i = 0; i < puzzleCount; i++) {
-      if (puzzleMatchesTheme(i) && !isPuzzleSolved(i)) {
-        if (count == target) {
-          loadPuzzleFromPack(i);
-          return;
-        }
-        count++;
-      }
+    if (!themeQuery.addTheme(basePath + theme, op)) {
+      Serial.printf("[CHESS] Query skips theme %s\n", theme.c_str());
+      continue;
     }
+    *part += (part->empty() ? (part == &notPart ? "-" : "") : separator) + theme;
+  }
+  
+  queryLabel = andPart;
+  if (!orPart.empty()) {
+    queryLabel += (queryLabel.empty() ? "" : " & ") + (andPart.empty() ? orPart : "(" + orPart + ")");
+  }
+  if (!notPart.empty()) {
+    queryLabel += (queryLabel.empty() ? "" : " ") + notPart;
+  }
+  if (queryRatingWindow && ratingIndex.isOpen()) {
+    themeQuery.setRatingRange(&ratingIndex, ratingWindowLow(), ratingWindowHigh());
+    char window[24];
+    snprintf(window, sizeof(window), "%u-%u", ratingWindowLow(), ratingWindowHigh());
+    queryLabel += (queryLabel.empty() ? "" : ", ") + std::string(window);
+  }
+  if (queryUnsolvedOnly && !solvedBitset.empty()) {
+    themeQuery.setExclude(&solvedBitset);
+    queryLabel += queryLabel.empty() ? "unsolved" : ", unsolved";
+  }
+  if (queryLabel.empty()) queryLabel = "all";
+  
+  themeQuery.start(puzzleCount > 0 ? esp_random() % puzzleCount : 0);
+  queryActive = true;
+  logEvent("QUERY", "terms=%d %s", themeQuery.termCount(), queryLabel.c_str());
+}
+
+// Next match from the query cursor. After a full pass that found something,
+// starts another pass so the training set can be played again. Unless
+// `take`, the cursor stays on the match, so a prefetch that is thrown away
+// does not skip it.
+bool ChessPuzzlesApp::pickQueryIndex(uint32_t& index, bool take) {
+  if (!queryActive || puzzleCount == 0) return false;
+  
+  const uint32_t startMs = millis();
+  bool found = take ? themeQuery.next(index) : themeQuery.peek(index);
+  if (!found && themeQuery.returned() > 0) {
+    themeQuery.start(esp_random() % puzzleCount);
+    found = take ? themeQuery.next(index) : themeQuery.peek(index);
+  }
+  if (found) {
+    logEvent("QUERY", "picked=%lu chunks=%lu ms=%lu", static_cast<unsigned long>(index),
+             static_cast<unsigned long>(themeQuery.chunksEvaluated()), static_cast<unsigned long>(millis() - startMs));
+  }
+  return found;
+}
+
+void ChessPuzzlesApp::loadNextQueryPuzzle() {
+  uint32_t index = 0;
+  if (pickQueryIndex(index) && loadPuzzleFromPack(index)) {
+    return;
+  }
+  loadRandomPuzzle();
+}
+
+void ChessPuzzlesApp::loadRandomThemedPuzzle() {
+  uint32_t index = 0;
+  if (pickThemedIndex(index) && loadPuzzleFromPack(index)) {
+    return;
+  }
+  loadRandomPuzzle();
+}
+
+std::string ChessPuzzlesApp::getRatingIndexPath() const {
+  return "/.crosspoint/chess/index/" + packName + "/rating.idx";
+}
+
+// Random unsolved puzzle in the rating window, other than the current one,
+// so prefetching picks from the same puzzles a pick after solving would
+void ChessPuzzlesApp::ratingWindow(uint16_t& lo, uint16_t& hi) const {
+  const uint32_t top = static_cast<uint32_t>(ratingTarget) + RATING_WINDOW - 1;
+  const uint16_t wantLo = ratingTarget > RATING_WINDOW ? ratingTarget - RATING_WINDOW : 0;
+  const uint16_t wantHi = static_cast<uint16_t>(top < 0xFFFF ? top : 0xFFFF);
+  if (!ratingIndex.coveredRange(wantLo, wantHi, lo, hi)) {
+    lo = wantLo;
+    hi = wantHi;
   }
+}
+
+uint16_t ChessPuzzlesApp::ratingWindowLow() const {
+  uint16_t lo, hi;
+  ratingWindow(lo, hi);
+  return lo;
+}
+
+uint16_t ChessPuzzlesApp::ratingWindowHigh() const {
+  uint16_t lo, hi;
+  ratingWindow(lo, hi);
+  return hi;
+}
+
+bool ChessPuzzlesApp::pickRatedIndex(uint32_t& index) {
+  if (puzzleCount == 0 || !ratingIndex.isOpen()) return false;
   
+  const uint32_t startMs = millis();
+  const Bitset* solved = solvedBitset.empty() ? nullptr : &solvedBitset;
+  const bool picked =
+      ratingIndex.pick(ratingWindowLow(), ratingWindowHigh(), solved, currentPuzzleIndex, esp_random(), index);
+  if (picked) {
+    logEvent("RATING", "picked=%lu ms=%lu", static_cast<unsigned long>(index),
+             static_cast<unsigned long>(millis() - startMs));
+  }
+  return picked;
+}
+
+void ChessPuzzlesApp::loadRandomRatedPuzzle() {
+  uint32_t index = 0;
+  if (pickRatedIndex(index) && loadPuzzleFromPack(index)) {
+    return;
+  }
   loadRandomPuzzle();
 }
 
@@ -1725,35 +2270,79 @@ void ChessPuzzlesApp::renderThemeSelect() {
     const int itemWidth = (screenWidth - 80) < 360 ? (screenWidth - 80) : 360;
     int listX = (screenWidth - itemWidth) / 2;
     
+    const int rowCount = THEME_OPTION_ROWS + static_cast<int>(availableThemes.size());
     int startIdx = 0;
     if (themeSelectIndex >= maxVisible) {
       startIdx = themeSelectIndex - maxVisible + 1;
     }
     
-    for (int i = 0; i < maxVisible && (startIdx + i) < static_cast<int>(availableThemes.size()); i++) {
+    for (int i = 0; i < maxVisible && (startIdx + i) < rowCount; i++) {
       int idx = startIdx + i;
       int y = startY + i * lineHeight;
       
-      const std::string& theme = availableThemes[idx];
-      std::string prettyTheme = theme;
-      std::replace(prettyTheme.begin(), prettyTheme.end(), '_', ' ');
+      std::string label;
+      if (idx == 0) {
+        label = queryUnsolvedOnly ? "Unsolved only: on" : "Unsolved only: off";
+      } else if (idx == 1) {
+        char window[40];
+        if (!ratingIndex.isOpen()) {
+          snprintf(window, sizeof(window), "Rating: no index");
+        } else if (queryRatingWindow) {
+          snprintf(window, sizeof(window), "Rating: %u-%u", ratingWindowLow(), ratingWindowHigh());
+        } else {
+          snprintf(window, sizeof(window), "Rating: any");
+        }
+        label = window;
+      } else {
+        static const char* const prefixes[] = { "", "[and] ", "[or] ", "[not] " };
+        const size_t theme = static_cast<size_t>(idx - THEME_OPTION_ROWS);
+        const ThemeToggle toggle = theme < themeToggles.size() ? themeToggles[theme] : ThemeToggle::Off;
+        label = prefixes[static_cast<int>(toggle)] + availableThemes[theme];
+        std::replace(label.begin(), label.end(), '_', ' ');
+      }
       
       if (idx == themeSelectIndex) {
         renderer.fillRect(listX, y - 2, itemWidth, lineHeight - 4);
-        renderer.drawText(UI_10_FONT_ID, listX + 10, y, prettyTheme.c_str(), false);
+        renderer.drawText(UI_10_FONT_ID, listX + 10, y, label.c_str(), false);
       } else {
-        renderer.drawText(UI_10_FONT_ID, listX + 10, y, prettyTheme.c_str(), true);
+        renderer.drawText(UI_10_FONT_ID, listX + 10, y, label.c_str(), true);
       }
     }
     
-    if (availableThemes.size() > maxVisible) {
+    if (rowCount > maxVisible) {
       char scrollInfo[16];
-      snprintf(scrollInfo, sizeof(scrollInfo), "%d/%d", themeSelectIndex + 1, static_cast<int>(availableThemes.size()));
+      snprintf(scrollInfo, sizeof(scrollInfo), "%d/%d", themeSelectIndex + 1, rowCount);
       renderer.drawCenteredText(UI_10_FONT_ID, startY + maxVisible * lineHeight + 10, scrollInfo);
     }
   }
   
-  renderer.drawButtonHints(UI_10_FONT_ID, "Back", "Select", "", "");
+  renderer.drawButtonHints(UI_10_FONT_ID, "Back", "Play", "", "Toggle");
+}
+
+void ChessPuzzlesApp::renderRatingSelect() {
+  auto& renderer = renderer_;
+
+  renderer.drawCenteredText(UI_12_FONT_ID, 30, "Select Rating");
+  renderer.drawCenteredText(UI_10_FONT_ID, 60, packName.c_str());
+  
+  if (!ratingIndex.isOpen()) {
+    renderer.drawCenteredText(UI_10_FONT_ID, 170, "No rating index available");
+    renderer.drawCenteredText(UI_10_FONT_ID, 200, "Copy index folder to:");
+    renderer.drawCenteredText(UI_10_FONT_ID, 230, "/.crosspoint/chess/index/");
+    renderer.drawCenteredText(UI_10_FONT_ID, 260, packName.c_str());
+  } else {
+    char line[48];
+    snprintf(line, sizeof(line), "%u", ratingTarget);
+    renderer.drawCenteredText(UI_12_FONT_ID, 150, line);
+    snprintf(line, sizeof(line), "%u - %u", ratingWindowLow(), ratingWindowHigh());
+    renderer.drawCenteredText(UI_10_FONT_ID, 190, line);
+    snprintf(line, sizeof(line), "%lu puzzles",
+             static_cast<unsigned long>(ratingIndex.countInRange(ratingWindowLow(), ratingWindowHigh())));
+    renderer.drawCenteredText(UI_10_FONT_ID, 220, line);
+    renderer.drawCenteredText(UI_10_FONT_ID, 270, "Up/Down to change");
+  }
+  
+  renderer.drawButtonHints(UI_10_FONT_ID, "Back", "Play", "", "");
 }
 
 void ChessPuzzlesApp::renderSdCardError() {
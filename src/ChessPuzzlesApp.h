@@ -14,6 +14,13 @@
 #include <esp_partition.h>
 
 #include "ChessCore.h"
+#include "Bitset.h"
+#include "BitsetIndex.h"
+#include "ChessSearch.h"
+#include "PackReader.h"
+#include "RatingIndex.h"
+#include "ThemeBitmap.h"
+#include "ThemeQuery.h"
 
 class ChessPuzzlesApp final {
  public:
@@ -28,7 +35,7 @@ class ChessPuzzlesApp final {
   HalGPIO& input_;
   GfxRenderer renderer_;
 
-  enum class Mode { PackSelect, PackMenu, ThemeSelect, Browsing, Playing, InGameMenu };
+  enum class Mode { PackSelect, PackMenu, ThemeSelect, RatingSelect, Browsing, Playing, InGameMenu };
   Mode currentMode = Mode::PackSelect;
   
   TaskHandle_t displayTaskHandle = nullptr;
@@ -38,13 +45,29 @@ class ChessPuzzlesApp final {
   bool pendingFullRefresh = false;
 
   Chess::BoardState board;
+  // board.gameStatus(), updated whenever board changes so the display task,
+  // with its small stack, never generates moves
+  Chess::GameStatus boardStatus = Chess::GameStatus::Ongoing;
   bool playerIsWhite = true;
   
   Chess::Puzzle currentPuzzle;
   int currentMoveIndex = 0;
+  // Moves played on `board` since the puzzle was loaded, newest last.
+  Chess::UndoInfo moveHistory[Chess::MAX_SOLUTION_MOVES];
+  int moveHistoryCount = 0;
   bool puzzleSolved = false;
   bool puzzleFailed = false;
   bool hintActive = false;
+
+  // Used to check off-book moves; ~17 KB of fixed working memory plus a
+  // transposition table sized in onEnter() from the free heap.
+  Chess::Search engine;
+  static constexpr size_t TT_MIN_BYTES = 16 * 1024;
+  static constexpr size_t TT_MAX_BYTES = 64 * 1024;  // At most a quarter of the free heap
+  static constexpr uint32_t ALT_SEARCH_MS = 200;   // Per check: mate solver and both searches
+  static constexpr uint32_t ALT_SEARCH_NODES = 12000;
+  static constexpr int ALT_WIN_SCORE = 200;        // Still clearly winning (centipawns)
+  static constexpr int ALT_MAX_LOSS = 150;         // Allowed shortfall vs. the book move
   bool ignoreBackRelease = false;
   
   int cursorFile = 4;
@@ -52,7 +75,7 @@ class ChessPuzzlesApp final {
   
   bool pieceSelected = false;
   int selectedSquare = -1;
-  std::vector<Chess::Move> legalMovesFromSelected;
+  Chess::MoveList legalMovesFromSelected;
 
   std::vector<int> navigablePieces;
   int navigablePieceIndex = 0;
@@ -67,16 +90,22 @@ class ChessPuzzlesApp final {
   std::string packPath;
   std::string packName;
   uint32_t puzzleCount = 0;
-  uint16_t packRecordSize = Chess::RECORD_SIZE;
+  PackReader pack;  // Open from pack selection until back to the pack list
+
+  // One-slot read-ahead of the puzzle Next/Skip will load, filled from loop()
+  enum class PrefetchState { Empty, Ready, Failed };
+  PrefetchState prefetch = PrefetchState::Empty;
+  Chess::Puzzle prefetchedPuzzle;
+  uint32_t prefetchIndex = 0;
   uint32_t currentPuzzleIndex = 0;
   uint32_t solvedCount = 0;
   
   std::vector<std::string> availablePacks;
   int packSelectorIndex = 0;
   
-  enum class PackMenuItem { Continue, Random, Themes, Browse };
+  enum class PackMenuItem { Continue, Random, Themes, Rating, Browse };
   int packMenuIndex = 0;
-  static constexpr int PACK_MENU_ITEM_COUNT = 4;
+  static constexpr int PACK_MENU_ITEM_COUNT = 5;
   
   uint32_t browserIndex = 0;
 
@@ -85,12 +114,40 @@ class ChessPuzzlesApp final {
   static constexpr int IN_GAME_MENU_ITEM_COUNT = 5;
   static constexpr unsigned long IN_GAME_MENU_HOLD_MS = 800;
   
-  std::vector<uint8_t> solvedBitset;
+  Bitset solvedBitset;
+  BitsetIndex unsolvedIndex;  // Over solvedBitset, rebuilt by countSolvedPuzzles()
   
   std::vector<std::string> availableThemes;
   int themeSelectIndex = 0;
   std::string activeTheme;
-  std::vector<uint8_t> themeBitset;
+  ThemeBitmap themeBitmap;  // The active theme, read from SD a chunk at a time
+  std::vector<uint32_t> themeChunkTotal;     // Puzzles with the theme, per chunk
+  std::vector<uint32_t> themeChunkUnsolved;  // ... that are not solved yet
+  uint32_t themeTotal = 0;
+  uint32_t themeUnsolved = 0;
+  // The theme's unsolved puzzles in one chunk, with rank/select over them
+  static constexpr uint32_t NO_CHUNK = UINT32_MAX;
+  Bitset themeChunk;
+  BitsetIndex themeChunkIndex;
+  uint32_t themeChunkLoaded = NO_CHUNK;
+  // Records read per pick when the theme has no usable index file
+  static constexpr uint32_t THEME_SCAN_LIMIT = 2000;
+
+  // Theme screen toggles, combined into themeQuery on Play
+  enum class ThemeToggle : uint8_t { Off, And, Or, Not };
+  std::vector<ThemeToggle> themeToggles;  // Per availableThemes entry
+  bool queryUnsolvedOnly = false;
+  bool queryRatingWindow = false;
+  static constexpr int THEME_OPTION_ROWS = 2;  // Listed above the themes
+  ThemeQuery themeQuery;
+  bool queryActive = false;
+  std::string queryLabel;
+
+  RatingIndex ratingIndex;  // The pack's rating.idx, if it has one
+  bool ratingWindowActive = false;
+  uint16_t ratingTarget = 0;
+  static constexpr uint16_t RATING_WINDOW = 100;  // Either side of ratingTarget
+  static constexpr uint16_t RATING_STEP = 50;
   
   static void taskTrampoline(void* param);
   [[noreturn]] void displayTaskLoop();
@@ -99,6 +156,7 @@ class ChessPuzzlesApp final {
   void renderPackSelect();
   void renderPackMenu();
   void renderThemeSelect();
+  void renderRatingSelect();
   void renderBrowser();
   void renderInGameMenu();
   void renderBoard();
@@ -110,10 +168,16 @@ class ChessPuzzlesApp final {
   
   void loadAvailablePacks();
   bool loadPackInfo();
+  bool readPackRecord(uint32_t index, uint8_t* record);
+  bool readPuzzle(uint32_t index, Chess::Puzzle& out);
   bool loadPuzzleFromPack(uint32_t index);
+  void startPuzzle(uint32_t index);
   void loadNextPuzzle();
+  void advancePuzzle();
+  void prefetchNextPuzzle();
   void loadRandomPuzzle();
   void loadDemoPuzzle();
+  void restartPuzzle();
   
   void saveProgress();
   uint32_t loadProgress();
@@ -127,14 +191,33 @@ class ChessPuzzlesApp final {
   std::string getSolvedPath() const;
   
   void loadAvailableThemes();
-  void loadThemeBitset(const std::string& theme);
-  bool puzzleMatchesTheme(uint32_t index) const;
+  void loadThemeBitmap(const std::string& theme);
+  bool loadThemeChunk(uint32_t chunk);
+  bool isThemeUnsolved(uint32_t index);
+  bool pickThemedIndex(uint32_t& index);
+  bool scanThemedIndex(uint32_t& index);
+  void clearTheme();
   void loadRandomThemedPuzzle();
+  void toggleThemeRow(int row, int direction);
+  void startThemeQuery(int highlightedTheme);
+  bool pickQueryIndex(uint32_t& index, bool take = true);
+  void loadNextQueryPuzzle();
+
+  std::string getRatingIndexPath() const;
+  // ratingTarget +/- RATING_WINDOW, rounded out to the whole rating buckets
+  // puzzles are picked from, so the window shown is the one served
+  void ratingWindow(uint16_t& lo, uint16_t& hi) const;
+  uint16_t ratingWindowLow() const;
+  uint16_t ratingWindowHigh() const;
+  bool pickRatedIndex(uint32_t& index);
+  void loadRandomRatedPuzzle();
   
   void selectSquare(int sq);
   void deselectPiece();
   bool tryMove(const Chess::Move& move);
   void handlePlayerMove(const Chess::Move& move);
+  bool acceptsAlternativeMove(const Chess::Move& move, const Chess::Move& expected);
+  int remainingMateMoves() const;
   void playOpponentMove();
   void onPuzzleSolved();
   void onPuzzleFailed();
@@ -147,6 +230,8 @@ class ChessPuzzlesApp final {
   bool validatePartition(const esp_partition_t* partition);
   void returnToLauncher();
 
+  void handleInput();
+  bool inputPending() const;
   void logModeChange(Mode from, Mode to, const char* reason);
   void logEvent(const char* ev, const char* fmt = nullptr, ...) const;
   
@@ -0,0 +1,360 @@
+#include "ChessSearch.h"
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <chrono>
+#endif
+
+namespace Chess {
+
+namespace {
+    // How often (in nodes) the clock is read
+    constexpr uint32_t TIME_CHECK_INTERVAL = 256;
+
+    uint32_t nowMs() {
+#ifdef ARDUINO
+        return millis();
+#else
+        using namespace std::chrono;
+        return static_cast<uint32_t>(
+            duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    // Only run the exchange when taking with a more valuable piece; anything
+    // else wins at least the victim's value.
+    bool isLosingCapture(const BoardState& state, const Move& m) {
+        const Piece victim = state.board[m.to()];
+        const int victimValue = victim != NONE ? PIECE_VALUES[pieceType(victim)] : PIECE_VALUES[PAWN];
+        const int attackerType = pieceType(state.board[m.from()]);
+        if (attackerType != KING && PIECE_VALUES[attackerType] <= victimValue) return false;
+        return state.see(m) < 0;
+    }
+
+    // Mate scores are stored relative to the node, not the root, so an entry
+    // stays valid when the same position is reached at a different ply.
+    int scoreToTT(int score, int ply) {
+        if (score >= MATE_BOUND) return score + ply;
+        if (score <= -MATE_BOUND) return score - ply;
+        return score;
+    }
+
+    int scoreFromTT(int score, int ply) {
+        if (score >= MATE_BOUND) return score - ply;
+        if (score <= -MATE_BOUND) return score + ply;
+        return score;
+    }
+}
+
+int evaluate(const BoardState& state) {
+    int score = state.materialOf(true) - state.materialOf(false);
+    return state.whiteToMove ? score : -score;
+}
+
+void Search::clear() {
+    tt.clear();
+}
+
+SearchResult Search::run(const BoardState& root, const SearchLimits& searchLimits) {
+    pos = root;
+    limits = searchLimits;
+    historyBase = 0;
+    keyHistory[0] = pos.key;
+
+    SearchResult result;
+    result.score = iterate(result);
+    return result;
+}
+
+SearchResult Search::scoreMove(const BoardState& root, const Move& move, const SearchLimits& searchLimits) {
+    pos = root;
+    limits = searchLimits;
+
+    // Keep the root in the history so a reply that repeats it is seen as a draw
+    keyHistory[0] = pos.key;
+    pos.makeMove(move, undo[0]);
+    historyBase = 1;
+    keyHistory[1] = pos.key;
+
+    // Plies count from the original root, so mate scores need no adjustment
+    SearchResult result;
+    result.score = -iterate(result);
+    result.bestMove = move;
+    return result;
+}
+
+int Search::iterate(SearchResult& result) {
+    startMs = nowMs();
+    nodes = 0;
+    stopped = false;
+    tt.newSearch();
+
+    MoveList& rootMoves = plyMoves[historyBase];
+    pos.generateLegalMoves(rootMoves);
+    if (rootMoves.empty()) {
+        result.depth = limits.maxDepth;
+        result.timeMs = nowMs() - startMs;
+        return pos.inCheck() ? -MATE_SCORE + historyBase : 0;
+    }
+
+    // Something sensible to return even if the first iteration is cut short
+    result.bestMove = rootMoves[0];
+    int score = 0;
+
+    for (int depth = 1; depth <= limits.maxDepth && depth < MAX_PLY - historyBase; depth++) {
+        int iterationScore = alphaBeta(depth, historyBase, -INFINITE_SCORE, INFINITE_SCORE);
+        if (stopped) {
+            result.aborted = true;
+            break;
+        }
+
+        score = iterationScore;
+        result.depth = depth;
+        const TTEntry* entry = tt.probe(pos.key);
+        if (entry && entry->move) result.bestMove = entry->bestMove();
+
+        // A forced mate found at this depth will not get shorter
+        if (isMateScore(score)) break;
+    }
+
+    result.nodes = nodes;
+    result.timeMs = nowMs() - startMs;
+    return score;
+}
+
+MateResult Search::findMates(const BoardState& root, int maxMoves, const SearchLimits& searchLimits,
+                             MoveList& mates) {
+    pos = root;
+    limits = searchLimits;
+    historyBase = 0;
+    startMs = nowMs();
+    nodes = 0;
+    stopped = false;
+    mates.clear();
+    if (maxMoves > MAX_PLY / 2) maxMoves = MAX_PLY / 2;
+
+    MateResult result;
+    MoveList& rootMoves = plyMoves[0];
+    pos.generateLegalMoves(rootMoves);
+    orderMoves(rootMoves, Move(0, 0, 0));
+
+    // Deepen per move, so each mating move is found at its shortest length
+    // and the cheap mate-in-1 checks run before anything deeper.
+    bool mating[MoveList::CAPACITY] = {};
+    for (int n = 1; n <= maxMoves && !stopped; n++) {
+        for (int i = 0; i < rootMoves.count && !stopped; i++) {
+            if (mating[i]) continue;
+            pos.makeMove(rootMoves[i], undo[0]);
+            bool mate = pos.inCheck() && defenderIsMated(1, n - 1);
+            pos.unmakeMove(undo[0]);
+            if (mate && !stopped) {
+                mating[i] = true;
+                mates.push(rootMoves[i]);
+                if (result.mateIn == 0) result.mateIn = n;
+            }
+        }
+    }
+
+    result.nodes = nodes;
+    result.timeMs = nowMs() - startMs;
+    result.aborted = stopped;
+    return result;
+}
+
+// Attacker to move with movesLeft >= 1: is there a check that mates in time?
+bool Search::attackerMates(int ply, int movesLeft) {
+    nodes++;
+    if (checkBudget()) return false;
+
+    MoveList& moves = plyMoves[ply];
+    pos.generateLegalMoves(moves);
+    orderMoves(moves, Move(0, 0, 0));
+
+    for (const Move& m : moves) {
+        pos.makeMove(m, undo[ply]);
+        bool mate = pos.inCheck() && defenderIsMated(ply + 1, movesLeft - 1);
+        pos.unmakeMove(undo[ply]);
+        if (mate) return true;
+        if (stopped) return false;
+    }
+    return false;
+}
+
+// Defender to move (and in check): does every reply still lose in time?
+bool Search::defenderIsMated(int ply, int movesLeft) {
+    nodes++;
+    if (checkBudget()) return false;
+
+    MoveList& moves = plyMoves[ply];
+    pos.generateLegalMoves(moves);
+    if (moves.empty()) return true;
+    if (movesLeft == 0) return false;
+
+    // Captures first: taking the checking piece is the likeliest refutation
+    orderMoves(moves, Move(0, 0, 0));
+    for (const Move& m : moves) {
+        pos.makeMove(m, undo[ply]);
+        bool mated = attackerMates(ply + 1, movesLeft);
+        pos.unmakeMove(undo[ply]);
+        if (!mated) return false;
+    }
+    return true;
+}
+
+bool Search::checkBudget() {
+    if (stopped) return true;
+    if (nodes >= limits.maxNodes) {
+        stopped = true;
+    } else if ((nodes % TIME_CHECK_INTERVAL) == 0 && nowMs() - startMs >= limits.maxTimeMs) {
+        stopped = true;
+    }
+    return stopped;
+}
+
+bool Search::isRepetition(int ply) const {
+    for (int i = ply - 2; i >= 0; i -= 2) {
+        if (keyHistory[i] == keyHistory[ply]) return true;
+    }
+    return false;
+}
+
+// TT move first, then captures that do not lose material (by most valuable
+// victim / least valuable attacker), then promotions, then quiet moves in
+// generation order, and losing captures last.
+void Search::orderMoves(MoveList& moves, const Move& ttMove) const {
+    for (Move& m : moves) {
+        int score = 0;
+        if (!ttMove.isNull() && m == ttMove) {
+            score = Move::MAX_SCORE;
+        } else if (m.isCapture()) {
+            // En passant leaves `to` empty; its victim is a pawn
+            int victim = m.isEnPassant() ? PAWN : pieceType(pos.board[m.to()]);
+            score = victim * 16 - pieceType(pos.board[m.from()]);
+            score += isLosingCapture(pos, m) ? -1024 : 1024;
+        }
+        if (m.promo() > 0) score += 512 + m.promo();
+        m.setScore(score);
+    }
+
+    // Insertion sort: lists are short and mostly need only a few swaps
+    for (int i = 1; i < moves.count; i++) {
+        Move m = moves[i];
+        int j = i - 1;
+        while (j >= 0 && moves[j].score() < m.score()) {
+            moves[j + 1] = moves[j];
+            j--;
+        }
+        moves[j + 1] = m;
+    }
+}
+
+int Search::alphaBeta(int depth, int ply, int alpha, int beta) {
+    const bool root = ply == historyBase;
+    if (!root) {
+        if (pos.halfmoveClock >= 100 || isRepetition(ply)) return 0;
+    }
+
+    const bool inCheck = pos.inCheck();
+    if (inCheck && ply + depth < MAX_PLY - 1) depth++;
+    if (depth <= 0) return quiesce(ply, alpha, beta);
+
+    nodes++;
+    if (checkBudget()) return 0;
+    if (ply >= MAX_PLY - 1) return evaluate(pos);
+
+    Move ttMove(0, 0, 0);
+    if (const TTEntry* entry = tt.probe(pos.key)) {
+        ttMove = entry->bestMove();
+        if (!root && entry->depth >= depth) {
+            int ttScore = scoreFromTT(entry->score, ply);
+            if (entry->bound() == TT_EXACT) return ttScore;
+            if (entry->bound() == TT_LOWER && ttScore >= beta) return ttScore;
+            if (entry->bound() == TT_UPPER && ttScore <= alpha) return ttScore;
+        }
+    }
+
+    MoveList& moves = plyMoves[ply];
+    pos.generateLegalMoves(moves);
+    if (moves.empty()) {
+        return inCheck ? -MATE_SCORE + ply : 0;
+    }
+    orderMoves(moves, ttMove);
+
+    const int originalAlpha = alpha;
+    int bestScore = -INFINITE_SCORE;
+    Move bestMove = moves[0];
+
+    for (const Move& m : moves) {
+        pos.makeMove(m, undo[ply]);
+        keyHistory[ply + 1] = pos.key;
+        int score = -alphaBeta(depth - 1, ply + 1, -beta, -alpha);
+        pos.unmakeMove(undo[ply]);
+        if (stopped) return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            bestMove = m;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) break;
+            }
+        }
+    }
+
+    TTBound bound = bestScore >= beta ? TT_LOWER : (bestScore > originalAlpha ? TT_EXACT : TT_UPPER);
+    tt.store(pos.key, depth, scoreToTT(bestScore, ply), bound, bestMove);
+    return bestScore;
+}
+
+// Captures and promotions only, so leaf scores do not hinge on a piece that
+// is about to be taken. In check every evasion is searched instead.
+int Search::quiesce(int ply, int alpha, int beta) {
+    nodes++;
+    if (checkBudget()) return 0;
+
+    const bool inCheck = pos.inCheck();
+    int bestScore = -INFINITE_SCORE;
+    if (!inCheck) {
+        bestScore = evaluate(pos);
+        if (bestScore >= beta) return bestScore;
+        if (bestScore > alpha) alpha = bestScore;
+    }
+    if (ply >= MAX_PLY - 1) return evaluate(pos);
+
+    MoveList& moves = plyMoves[ply];
+    pos.generateLegalMoves(moves);
+    if (moves.empty()) {
+        return inCheck ? -MATE_SCORE + ply : 0;
+    }
+
+    if (!inCheck) {
+        // Losing captures cannot raise the stand-pat score, so skip them
+        int kept = 0;
+        for (int i = 0; i < moves.count; i++) {
+            const Move& m = moves[i];
+            if (m.promo() > 0 || (m.isCapture() && !isLosingCapture(pos, m))) moves[kept++] = m;
+        }
+        moves.count = kept;
+    }
+    orderMoves(moves, Move(0, 0, 0));
+
+    for (const Move& m : moves) {
+        pos.makeMove(m, undo[ply]);
+        keyHistory[ply + 1] = pos.key;
+        int score = -quiesce(ply + 1, -beta, -alpha);
+        pos.unmakeMove(undo[ply]);
+        if (stopped) return 0;
+
+        if (score > bestScore) {
+            bestScore = score;
+            if (score > alpha) {
+                alpha = score;
+                if (alpha >= beta) break;
+            }
+        }
+    }
+    return bestScore;
+}
+
+}  // namespace Chess
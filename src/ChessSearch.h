@@ -0,0 +1,105 @@
+#pragma once
+
+#include "ChessCore.h"
+#include "ChessTT.h"
+
+namespace Chess {
+
+// ============================================================================
+// Scores
+// ============================================================================
+
+// Centipawn scores from the side to move's point of view. Mates are encoded
+// as MATE_SCORE minus the distance in plies, so shorter mates score higher.
+static constexpr int MATE_SCORE = 30000;
+static constexpr int MATE_BOUND = MATE_SCORE - 256;
+static constexpr int INFINITE_SCORE = MATE_SCORE + 1;
+
+inline bool isMateScore(int score) { return score >= MATE_BOUND || score <= -MATE_BOUND; }
+
+// Static evaluation: material balance from the side to move's point of view
+int evaluate(const BoardState& state);
+
+// ============================================================================
+// Alpha-beta search
+// ============================================================================
+
+struct SearchLimits {
+    int maxDepth = 8;
+    uint32_t maxNodes = 20000;
+    uint32_t maxTimeMs = 200;
+};
+
+struct SearchResult {
+    Move bestMove = Move(0, 0, 0);
+    int score = 0;
+    int depth = 0;         // Last fully completed iteration
+    uint32_t nodes = 0;
+    uint32_t timeMs = 0;
+    bool aborted = false;  // Budget ran out before maxDepth was reached
+};
+
+struct MateResult {
+    int mateIn = 0;        // Shortest forced mate found, in moves; 0 if none
+    uint32_t nodes = 0;
+    uint32_t timeMs = 0;
+    bool aborted = false;  // Budget ran out; moves not yet tried may also mate
+};
+
+// Iterative-deepening alpha-beta with quiescence and a transposition table.
+// The per-ply move buffers live inside the object and the table is one block
+// allocated by resizeTable(), so a search never allocates and its stack use
+// does not grow with depth. Create one instance and reuse it. Without a
+// table the search still works, only slower.
+class Search {
+public:
+    static constexpr int MAX_PLY = 16;
+
+    Search() = default;
+
+    // Allocate the transposition table (see TranspositionTable::resize)
+    bool resizeTable(size_t bytes) { return tt.resize(bytes); }
+    void releaseTable() { tt.release(); }
+    const TranspositionTable& table() const { return tt; }
+
+    // Search the position within the limits and return the best line's first move
+    SearchResult run(const BoardState& root, const SearchLimits& limits);
+
+    // Score of playing `move` from `root`, from the mover's point of view.
+    // The move must be legal.
+    SearchResult scoreMove(const BoardState& root, const Move& move, const SearchLimits& limits);
+
+    // Checks-only mate search: collect every first move that forces mate in
+    // at most maxMoves moves when the attacker (side to move) only plays
+    // checks. Much cheaper than run() on mating puzzles, but a mate that
+    // starts with, or contains, a quiet attacking move is not found.
+    // maxMoves is capped at MAX_PLY / 2.
+    MateResult findMates(const BoardState& root, int maxMoves, const SearchLimits& limits, MoveList& mates);
+
+    // Forget all cached positions
+    void clear();
+
+private:
+    BoardState pos;
+    UndoInfo undo[MAX_PLY];
+    uint64_t keyHistory[MAX_PLY + 1];  // Position key at each ply, for repetitions
+    int historyBase = 0;               // Ply of the search root (1 in scoreMove)
+    MoveList plyMoves[MAX_PLY];
+    TranspositionTable tt;
+
+    SearchLimits limits;
+    uint32_t startMs = 0;
+    uint32_t nodes = 0;
+    bool stopped = false;
+
+    int iterate(SearchResult& result);
+    int alphaBeta(int depth, int ply, int alpha, int beta);
+    int quiesce(int ply, int alpha, int beta);
+    bool attackerMates(int ply, int movesLeft);
+    bool defenderIsMated(int ply, int movesLeft);
+    bool isRepetition(int ply) const;
+    void orderMoves(MoveList& moves, const Move& ttMove) const;
+    bool checkBudget();
+};
+
+}  // namespace Chess
@@ -0,0 +1,122 @@
+#include "ChessTT.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace Chess {
+
+static_assert(sizeof(TTEntry) == 8, "TT entries must stay 8 bytes");
+
+namespace {
+    uint16_t checkOf(uint64_t key) { return static_cast<uint16_t>(key >> 48); }
+}
+
+TranspositionTable::~TranspositionTable() {
+    release();
+}
+
+bool TranspositionTable::resize(size_t bytes) {
+    release();
+
+    size_t count = 1;
+    while (count * 2 * sizeof(Bucket) <= bytes) {
+        count *= 2;
+    }
+    if (count * sizeof(Bucket) > bytes) return false;
+
+    buckets = static_cast<Bucket*>(malloc(count * sizeof(Bucket)));
+    if (!buckets) return false;
+
+    bucketCount = count;
+    clear();
+    return true;
+}
+
+void TranspositionTable::release() {
+    free(buckets);
+    buckets = nullptr;
+    bucketCount = 0;
+}
+
+void TranspositionTable::clear() {
+    if (buckets) memset(buckets, 0, bucketCount * sizeof(Bucket));
+    generation = 0;
+    resetStats();
+}
+
+const TTEntry* TranspositionTable::probe(uint64_t key) {
+    if (!bucketCount) return nullptr;
+
+    counters.probes++;
+    const uint16_t check = checkOf(key);
+    Bucket& bucket = bucketFor(key);
+    for (TTEntry& entry : bucket.entries) {
+        if (entry.check == check && entry.bound() != TT_NONE) {
+            // Refresh the age so entries still in use are not evicted
+            entry.genBound = static_cast<uint8_t>((generation << 2) | entry.bound());
+            counters.hits++;
+            return &entry;
+        }
+    }
+    counters.misses++;
+    return nullptr;
+}
+
+void TranspositionTable::store(uint64_t key, int depth, int score, TTBound bound, const Move& move) {
+    if (!bucketCount) return;
+
+    counters.stores++;
+    const uint16_t check = checkOf(key);
+    Bucket& bucket = bucketFor(key);
+
+    TTEntry* target = nullptr;
+    for (TTEntry& entry : bucket.entries) {
+        if (entry.check == check && entry.bound() != TT_NONE) {
+            target = &entry;
+            break;
+        }
+    }
+
+    if (target) {
+        // Same position: keep a deeper result from this search unless the new one is exact
+        if (age(*target) == 0 && target->depth > depth && bound != TT_EXACT) return;
+        // Keep the old best move rather than forget it
+        if (!move.isNull()) target->move = move.pack();
+    } else {
+        // Prefer an empty slot, then the shallowest, oldest entry
+        int worst = 0;
+        for (TTEntry& entry : bucket.entries) {
+            if (entry.bound() == TT_NONE) {
+                target = &entry;
+                break;
+            }
+            int value = entry.depth - 8 * age(entry);
+            if (!target || value < worst) {
+                target = &entry;
+                worst = value;
+            }
+        }
+        if (target->bound() != TT_NONE) counters.replacements++;
+        target->move = move.isNull() ? 0 : move.pack();
+    }
+
+    target->check = check;
+    target->score = static_cast<int16_t>(score);
+    target->depth = static_cast<int8_t>(depth);
+    target->genBound = static_cast<uint8_t>((generation << 2) | bound);
+}
+
+int TranspositionTable::hashfull() const {
+    if (!bucketCount) return 0;
+
+    const size_t sample = bucketCount < 250 ? bucketCount : 250;
+    int used = 0;
+    for (size_t i = 0; i < sample; i++) {
+        for (const TTEntry& entry : buckets[i].entries) {
+            if (entry.bound() != TT_NONE && age(entry) == 0) used++;
+        }
+    }
+    return static_cast<int>(used * 1000 / (sample * BUCKET_SIZE));
+}
+
+}  // namespace Chess
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "ChessCore.h"
+
+namespace Chess {
+
+// ============================================================================
+// Transposition table
+// ============================================================================
+
+#ifdef ARDUINO
+static constexpr size_t DEFAULT_TT_BYTES = 32 * 1024;
+#else
+static constexpr size_t DEFAULT_TT_BYTES = 4 * 1024 * 1024;
+#endif
+
+enum TTBound : uint8_t { TT_NONE = 0, TT_EXACT = 1, TT_LOWER = 2, TT_UPPER = 3 };
+
+// 8-byte entry; four of them make one 32-byte bucket
+struct TTEntry {
+    uint16_t check;     // Top 16 bits of the Zobrist key
+    uint16_t move;      // Move::pack(), 0 if none
+    int16_t score;      // Caller-defined (the search stores mate scores node-relative)
+    int8_t depth;
+    uint8_t genBound;   // Generation (upper 6 bits) | TTBound (lower 2 bits)
+
+    TTBound bound() const { return static_cast<TTBound>(genBound & 3); }
+    Move bestMove() const { return Move::unpack(move); }
+};
+
+struct TTStats {
+    uint32_t probes = 0;
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+    uint32_t stores = 0;
+    uint32_t replacements = 0;  // Stores that evicted a different position
+};
+
+// Bucketed table in one block allocated by resize(). The low key bits pick a
+// bucket; the top 16 bits verify the entry. When a bucket is full, the entry
+// with the lowest depth, adjusted for age, is replaced, so results from
+// earlier searches give way first.
+class TranspositionTable {
+public:
+    static constexpr int BUCKET_SIZE = 4;
+
+    TranspositionTable() = default;
+    ~TranspositionTable();
+    TranspositionTable(const TranspositionTable&) = delete;
+    TranspositionTable& operator=(const TranspositionTable&) = delete;
+
+    // Allocate the table, using at most `bytes` (rounded down to a power of
+    // two number of buckets). Frees any previous table. Returns false and
+    // leaves the table empty if the allocation fails or bytes is too small.
+    bool resize(size_t bytes);
+    void release();
+
+    // Empty all entries and restart the generation count
+    void clear();
+
+    // Start a new search: entries from older searches become cheaper to evict
+    void newSearch() { generation = (generation + 1) & 63; }
+
+    // Matching entry for key, or nullptr. Valid until the next store().
+    const TTEntry* probe(uint64_t key);
+
+    void store(uint64_t key, int depth, int score, TTBound bound, const Move& move);
+
+    size_t sizeBytes() const { return bucketCount * sizeof(Bucket); }
+    size_t capacity() const { return bucketCount * BUCKET_SIZE; }
+
+    // Share of the first 250 buckets' entries written in the current search, per mille
+    int hashfull() const;
+
+    const TTStats& stats() const { return counters; }
+    void resetStats() { counters = TTStats(); }
+
+private:
+    struct Bucket {
+        TTEntry entries[BUCKET_SIZE];
+    };
+
+    Bucket* buckets = nullptr;
+    size_t bucketCount = 0;  // Power of two, or 0 when unallocated
+    uint8_t generation = 0;
+    TTStats counters;
+
+    Bucket& bucketFor(uint64_t key) { return buckets[key & (bucketCount - 1)]; }
+    int age(const TTEntry& entry) const { return (generation - (entry.genBound >> 2)) & 63; }
+};
+
+}  // namespace Chess
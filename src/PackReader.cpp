@@ -0,0 +1,197 @@
+#include "PackReader.h"
+
+#include <Arduino.h>
+#include <SDCardManager.h>
+
+#include <cstring>
+#include <vector>
+
+bool PackReader::open(const std::string& path) {
+  close();
+
+  if (!SdMan.openFileForRead("CHESS", path, file)) {
+    Serial.println("[CHESS] Failed to open pack file");
+    return false;
+  }
+  opened = true;
+  fileSize = file.size();
+
+  uint8_t headerData[Chess::PACK2_HEADER_SIZE];
+  const size_t headerBytes = fileSize < sizeof(headerData) ? fileSize : sizeof(headerData);
+  if (!read(0, headerData, headerBytes)) {
+    Serial.println("[CHESS] Failed to read pack header");
+    close();
+    return false;
+  }
+  if (!Chess::PackHeader::fromFile(headerData, headerBytes, packHeader)) {
+    Serial.println("[CHESS] Invalid pack header");
+    close();
+    return false;
+  }
+  if (packHeader.version == 2) {
+    if (!loadStrings()) {
+      Serial.println("[CHESS] Invalid pack string table");
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  // Allow pack files to evolve record size while keeping backward compatibility.
+  if (packHeader.recordSize < Chess::RECORD_SIZE || packHeader.recordSize > Chess::MAX_RECORD_SIZE) {
+    Serial.printf("[CHESS] Invalid record size %d; using default %d\n", packHeader.recordSize, Chess::RECORD_SIZE);
+    packHeader.recordSize = Chess::RECORD_SIZE;
+  }
+  return true;
+}
+
+void PackReader::close() {
+  if (opened) {
+    file.close();
+  }
+  opened = false;
+  fileSize = 0;
+  packHeader = {};
+  packStrings.clear();
+  cursor = BlockCursor();
+  for (Sector& sector : cache) {
+    sector.lastUse = 0;
+  }
+  useClock = 0;
+}
+
+bool PackReader::readRecord(uint32_t index, uint8_t* out) {
+  if (!opened || index >= packHeader.puzzleCount) {
+    return false;
+  }
+  if (packHeader.version == 2) {
+    return readPackedRecord(index, out);
+  }
+  if (!read(Chess::PACK_HEADER_SIZE + index * packHeader.recordSize, out, packHeader.recordSize)) {
+    return false;
+  }
+  packStrings.internRecord(out, packHeader.recordSize);
+  return true;
+}
+
+bool PackReader::loadStrings() {
+  if (packHeader.stringsOffset == 0) {
+    return true;
+  }
+  if (packHeader.stringsOffset > fileSize || fileSize - packHeader.stringsOffset > MAX_STRINGS_BYTES) {
+    return false;
+  }
+
+  // Only needed while parsing; the names are copied into packStrings
+  std::vector<uint8_t> table(fileSize - packHeader.stringsOffset);
+  if (!read(packHeader.stringsOffset, table.data(), table.size())) {
+    return false;
+  }
+  return packStrings.load(table.data(), table.size());
+}
+
+bool PackReader::readPackedRecord(uint32_t index, uint8_t* out) {
+  const uint32_t block = index / packHeader.blockRecords;
+  uint32_t skip = index % packHeader.blockRecords;
+  uint32_t offset = 0;
+  uint32_t end = 0;
+
+  if (cursor.valid && cursor.block == block && cursor.nextIndex <= index) {
+    skip = index - cursor.nextIndex;
+    offset = cursor.offset;
+    end = cursor.end;
+  } else {
+    uint8_t entry[8];
+    if (!read(packHeader.indexOffset + block * 4, entry, sizeof(entry))) {
+      return false;
+    }
+    offset = entry[0] | (entry[1] << 8) | (entry[2] << 16) | (static_cast<uint32_t>(entry[3]) << 24);
+    end = entry[4] | (entry[5] << 8) | (entry[6] << 16) | (static_cast<uint32_t>(entry[7]) << 24);
+    if (end < offset || end > fileSize) {
+      return false;
+    }
+  }
+
+  cursor.valid = false;
+  uint8_t packed[Chess::MAX_PACKED_RECORD_SIZE];
+  while (true) {
+    const size_t len = end - offset < sizeof(packed) ? end - offset : sizeof(packed);
+    if (!read(offset, packed, len)) {
+      return false;
+    }
+    const size_t used = Chess::expandPackedRecord(packed, len, skip == 0 ? out : nullptr);
+    if (used == 0) {
+      return false;
+    }
+    offset += used;
+    if (skip == 0) {
+      break;
+    }
+    skip--;
+  }
+
+  cursor.valid = true;
+  cursor.block = block;
+  cursor.nextIndex = index + 1;
+  cursor.offset = offset;
+  cursor.end = end;
+  return true;
+}
+
+bool PackReader::read(uint32_t offset, uint8_t* out, size_t len) {
+  if (!opened || offset > fileSize || len > fileSize - offset) {
+    return false;
+  }
+
+  while (len > 0) {
+    const Sector* sector = loadSector(offset / SECTOR_SIZE);
+    if (!sector) {
+      return false;
+    }
+
+    const size_t start = offset % SECTOR_SIZE;
+    if (start >= sector->length) {
+      return false;
+    }
+    size_t chunk = sector->length - start;
+    if (chunk > len) {
+      chunk = len;
+    }
+
+    memcpy(out, sector->data + start, chunk);
+    out += chunk;
+    offset += chunk;
+    len -= chunk;
+  }
+  return true;
+}
+
+const PackReader::Sector* PackReader::loadSector(uint32_t index) {
+  useClock++;
+
+  Sector* victim = &cache[0];
+  for (Sector& sector : cache) {
+    if (sector.lastUse != 0 && sector.index == index) {
+      sector.lastUse = useClock;
+      counters.hits++;
+      return &sector;
+    }
+    // Empty slots have lastUse 0, so they are taken first
+    if (sector.lastUse < victim->lastUse) {
+      victim = &sector;
+    }
+  }
+
+  counters.misses++;
+  const uint32_t offset = index * SECTOR_SIZE;
+  size_t length = fileSize - offset < SECTOR_SIZE ? fileSize - offset : SECTOR_SIZE;
+  victim->lastUse = 0;
+  if (!file.seek(offset) || file.read(victim->data, length) != static_cast<int>(length)) {
+    return nullptr;
+  }
+
+  victim->index = index;
+  victim->length = length;
+  victim->lastUse = useClock;
+  return victim;
+}
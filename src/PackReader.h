@@ -0,0 +1,85 @@
+#pragma once
+
+#include <SdFat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "ChessCore.h"
+
+// Reads records from one open .cpz pack (CPZ1 or CPZ2). The file stays open
+// between reads, so moving to another puzzle costs a seek instead of a FAT
+// directory lookup, and recently used 512-byte sectors are kept in a small
+// LRU cache so that neighbouring records (Next, Retry, the browser) are
+// served from RAM. CPZ2 blocks are decoded one record at a time through the
+// cache, so no block buffer is needed.
+class PackReader {
+ public:
+  static constexpr size_t SECTOR_SIZE = 512;
+  static constexpr int CACHE_SECTORS = 4;
+  static constexpr size_t MAX_STRINGS_BYTES = 32 * 1024;
+
+  struct Stats {
+    uint32_t hits = 0;    // Sector reads served from the cache
+    uint32_t misses = 0;  // Sector reads that went to the card
+  };
+
+  PackReader() = default;
+  ~PackReader() { close(); }
+  PackReader(const PackReader&) = delete;
+  PackReader& operator=(const PackReader&) = delete;
+
+  // Open the pack and parse its header. Closes any pack already open.
+  // An out-of-range record size falls back to Chess::RECORD_SIZE.
+  bool open(const std::string& path);
+  void close();
+  bool isOpen() const { return opened; }
+
+  const Chess::PackHeader& header() const { return packHeader; }
+  uint32_t puzzleCount() const { return packHeader.puzzleCount; }
+  uint16_t recordSize() const { return packHeader.recordSize; }
+  const Chess::PackStrings& strings() const { return packStrings; }
+
+  // Copy record `index` (recordSize() bytes) into out, in the layout
+  // PuzzleView reads: CPZ2 records are expanded and CPZ1 text fields are
+  // interned into strings().
+  bool readRecord(uint32_t index, uint8_t* out);
+
+  // Copy len bytes starting at offset into out, through the sector cache
+  bool read(uint32_t offset, uint8_t* out, size_t len);
+
+  const Stats& stats() const { return counters; }
+
+ private:
+  struct Sector {
+    uint32_t index = 0;
+    uint32_t lastUse = 0;  // 0 when the slot is empty
+    size_t length = 0;     // Shorter than SECTOR_SIZE only at the end of the file
+    uint8_t data[SECTOR_SIZE];
+  };
+
+  FsFile file;
+  bool opened = false;
+  uint32_t fileSize = 0;
+  Chess::PackHeader packHeader = {};
+  Chess::PackStrings packStrings;
+  Sector cache[CACHE_SECTORS];
+  uint32_t useClock = 0;
+  Stats counters;
+
+  // Where the CPZ2 record after the last one read starts, so reading
+  // forward through a block does not decode it again from the start
+  struct BlockCursor {
+    bool valid = false;
+    uint32_t block = 0;
+    uint32_t nextIndex = 0;
+    uint32_t offset = 0;
+    uint32_t end = 0;  // End of the block's data
+  };
+  BlockCursor cursor;
+
+  const Sector* loadSector(uint32_t index);
+  bool readPackedRecord(uint32_t index, uint8_t* out);
+  bool loadStrings();
+};
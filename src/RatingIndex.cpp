@@ -0,0 +1,269 @@
+#include "RatingIndex.h"
+
+#include <Arduino.h>
+#include <SDCardManager.h>
+
+#include <cstring>
+
+namespace {
+
+uint16_t readU16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+
+uint32_t readU32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// xorshift32; the state must not be 0
+uint32_t nextRandom(uint32_t& state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+}  // namespace
+
+bool RatingIndex::open(const std::string& path, uint32_t puzzleCount) {
+  close();
+
+  if (!SdMan.openFileForRead("CHESS", path, file)) {
+    Serial.printf("[CHESS] No rating index at %s\n", path.c_str());
+    return false;
+  }
+  opened = true;
+
+  uint8_t header[HEADER_SIZE];
+  if (file.read(header, HEADER_SIZE) != static_cast<int>(HEADER_SIZE) || memcmp(header, "RIX1", 4) != 0) {
+    Serial.println("[CHESS] Invalid rating index header");
+    close();
+    return false;
+  }
+  count = readU32(header + 4);
+  base = readU16(header + 8);
+  width = readU16(header + 10);
+  const uint16_t bucketCount = readU16(header + 12);
+
+  const uint32_t expectedSize = HEADER_SIZE + 4 * (bucketCount + 1) + 4 * count;
+  if (count != puzzleCount || width == 0 || bucketCount == 0 || bucketCount > MAX_BUCKETS ||
+      file.size() != expectedSize) {
+    Serial.printf("[CHESS] Rating index does not match pack (%lu puzzles, %u buckets)\n",
+                  static_cast<unsigned long>(count), bucketCount);
+    close();
+    return false;
+  }
+
+  std::vector<uint8_t> table(4 * (bucketCount + 1));
+  if (file.read(table.data(), table.size()) != static_cast<int>(table.size())) {
+    Serial.println("[CHESS] Failed to read rating buckets");
+    close();
+    return false;
+  }
+  bucketStart.resize(bucketCount + 1);
+  bool ordered = true;
+  for (size_t i = 0; i < bucketStart.size(); i++) {
+    bucketStart[i] = readU32(table.data() + 4 * i);
+    if (i > 0 && bucketStart[i] < bucketStart[i - 1]) ordered = false;
+  }
+  if (!ordered || bucketStart.front() != 0 || bucketStart.back() != count) {
+    Serial.println("[CHESS] Rating bucket table is inconsistent");
+    close();
+    return false;
+  }
+
+  Serial.printf("[CHESS] Loaded rating index (%u buckets of %u from %u)\n", bucketCount, width, base);
+  return true;
+}
+
+void RatingIndex::close() {
+  if (opened) {
+    file.close();
+  }
+  opened = false;
+  count = 0;
+  base = 0;
+  width = 0;
+  bucketStart.clear();
+}
+
+uint16_t RatingIndex::ratingMax() const {
+  if (bucketStart.empty()) {
+    return base;
+  }
+  // The top bucket may reach past the largest rating a uint16_t holds
+  const uint32_t top = base + static_cast<uint32_t>(bucketStart.size() - 1) * width - 1;
+  return static_cast<uint16_t>(top < 0xFFFF ? top : 0xFFFF);
+}
+
+void RatingIndex::bucketRange(uint16_t lo, uint16_t hi, uint32_t& firstBucket, uint32_t& endBucket) const {
+  firstBucket = endBucket = 0;
+  if (!opened || hi < lo || hi < base || lo > ratingMax()) {
+    return;
+  }
+  const uint32_t bucketCount = static_cast<uint32_t>(bucketStart.size()) - 1;
+  firstBucket = lo < base ? 0 : (lo - base) / width;
+  endBucket = (hi - base) / width + 1;
+  if (endBucket > bucketCount) endBucket = bucketCount;
+}
+
+bool RatingIndex::coveredRange(uint16_t lo, uint16_t hi, uint16_t& coveredLo, uint16_t& coveredHi) const {
+  uint32_t firstBucket, endBucket;
+  bucketRange(lo, hi, firstBucket, endBucket);
+  if (firstBucket == endBucket) {
+    return false;
+  }
+  const uint32_t top = base + endBucket * width - 1;
+  coveredLo = static_cast<uint16_t>(base + firstBucket * width);
+  coveredHi = static_cast<uint16_t>(top < 0xFFFF ? top : 0xFFFF);
+  return true;
+}
+
+void RatingIndex::listRange(uint16_t lo, uint16_t hi, uint32_t& first, uint32_t& end) const {
+  uint32_t firstBucket, endBucket;
+  bucketRange(lo, hi, firstBucket, endBucket);
+  first = bucketStart.empty() ? 0 : bucketStart[firstBucket];
+  end = bucketStart.empty() ? 0 : bucketStart[endBucket];
+}
+
+uint32_t RatingIndex::countInRange(uint16_t lo, uint16_t hi) const {
+  uint32_t first, end;
+  listRange(lo, hi, first, end);
+  return end - first;
+}
+
+bool RatingIndex::readEntries(uint32_t position, uint32_t* out, uint32_t n) {
+  const uint32_t offset = HEADER_SIZE + 4 * static_cast<uint32_t>(bucketStart.size()) + 4 * position;
+  const int bytes = static_cast<int>(4 * n);
+  // Little-endian file read straight into the words, as Bitset does
+  return file.seek(offset) && file.read(out, bytes) == bytes;
+}
+
+void RatingIndex::beginScan(uint16_t lo, uint16_t hi, Scan& scan) const {
+  uint32_t endBucket;
+  bucketRange(lo, hi, scan.firstBucket, endBucket);
+  scan.position.clear();
+  for (uint32_t b = scan.firstBucket; b < endBucket; b++) {
+    scan.position.push_back(bucketStart[b]);
+  }
+}
+
+// Advance position to the first entry in [position, end) that is not below
+// value: gallop ahead in doubling steps, so a short gap costs few reads, then
+// bisect with single-entry reads until one chunk is left
+bool RatingIndex::lowerBound(uint32_t& position, uint32_t end, uint32_t value) {
+  uint32_t entry;
+  for (uint32_t step = PICK_CHUNK; end - position > step; step *= 2) {
+    if (!readEntries(position + step, &entry, 1)) return false;
+    if (entry >= value) {
+      end = position + step;
+      break;
+    }
+    position += step + 1;
+  }
+  while (end - position >= PICK_CHUNK) {
+    const uint32_t mid = position + (end - position) / 2;
+    if (!readEntries(mid, &entry, 1)) return false;
+    if (entry < value) {
+      position = mid + 1;
+    } else {
+      end = mid;
+    }
+  }
+  return true;
+}
+
+bool RatingIndex::scanRange(Scan& scan, uint32_t first, Bitset& out) {
+  const uint32_t end = first + out.size();
+  uint32_t entries[PICK_CHUNK];
+  for (size_t i = 0; i < scan.position.size(); i++) {
+    uint32_t& position = scan.position[i];
+    const uint32_t bucketEnd = bucketStart[scan.firstBucket + i + 1];
+    while (position < bucketEnd) {
+      const uint32_t n = bucketEnd - position < PICK_CHUNK ? bucketEnd - position : PICK_CHUNK;
+      if (!readEntries(position, entries, n)) {
+        Serial.println("[CHESS] Failed to read rating index");
+        return false;
+      }
+      if (entries[n - 1] < first) {
+        // The whole chunk precedes the range: skip a gap without reading it
+        position += n;
+        if (!lowerBound(position, bucketEnd, first)) {
+          Serial.println("[CHESS] Failed to read rating index");
+          return false;
+        }
+        continue;
+      }
+      uint32_t used = 0;
+      while (used < n && entries[used] < end) {
+        if (entries[used] >= first) out.set(entries[used] - first);
+        used++;
+      }
+      position += used;
+      if (used < n) break;  // The rest belong to later ranges
+    }
+  }
+  return true;
+}
+
+bool RatingIndex::pick(uint16_t lo, uint16_t hi, const Bitset* solved, uint32_t skip, uint32_t seed,
+                       uint32_t& index) {
+  uint32_t first, end;
+  listRange(lo, hi, first, end);
+  if (first == end) {
+    return false;
+  }
+
+  const uint32_t total = end - first;
+  uint32_t state = seed != 0 ? seed : 1;
+  auto usable = [&](uint32_t candidate) { return candidate < count && candidate != skip; };
+  auto unsolved = [&](uint32_t candidate) { return !solved || !solved->test(candidate); };
+
+  // Each try is uniform over the window, so the first unsolved hit is
+  // uniform over its unsolved puzzles
+  for (int tries = 0; tries < PICK_TRIES; tries++) {
+    uint32_t candidate;
+    if (!readEntries(first + nextRandom(state) % total, &candidate, 1)) {
+      Serial.println("[CHESS] Failed to read rating index");
+      return false;
+    }
+    if (usable(candidate) && unsolved(candidate)) {
+      index = candidate;
+      return true;
+    }
+  }
+
+  // Mostly solved: one pass, reservoir sampling the unsolved puzzles, and
+  // the solved ones until an unsolved one turns up
+  uint32_t entries[PICK_CHUNK];
+  uint32_t unsolvedSeen = 0;
+  uint32_t solvedSeen = 0;
+  uint32_t unsolvedPick = 0;
+  uint32_t solvedPick = 0;
+  for (uint32_t position = first; position < end;) {
+    const uint32_t n = end - position < PICK_CHUNK ? end - position : PICK_CHUNK;
+    if (!readEntries(position, entries, n)) {
+      Serial.println("[CHESS] Failed to read rating index");
+      return false;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      const uint32_t candidate = entries[i];
+      if (!usable(candidate)) continue;
+      if (unsolved(candidate)) {
+        if (nextRandom(state) % ++unsolvedSeen == 0) unsolvedPick = candidate;
+      } else if (unsolvedSeen == 0) {
+        if (nextRandom(state) % ++solvedSeen == 0) solvedPick = candidate;
+      }
+    }
+    position += n;
+  }
+
+  if (unsolvedSeen > 0) {
+    index = unsolvedPick;
+    return true;
+  }
+  if (solvedSeen > 0) {
+    index = solvedPick;
+    return true;
+  }
+  return false;
+}
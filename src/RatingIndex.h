@@ -0,0 +1,78 @@
+#pragma once
+
+#include <SdFat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Bitset.h"
+
+// Reads a pack's rating.idx (written by tools/pack_lichess_cpz.py): the
+// puzzle indices grouped by rating bucket, each bucket in index order, plus
+// a table of where each bucket starts in that list. The bucket table is kept
+// in RAM and the file stays open, so picking a puzzle in a rating window is
+// usually a single read of one entry instead of a scan over the pack.
+class RatingIndex {
+ public:
+  static constexpr size_t HEADER_SIZE = 16;
+  static constexpr uint16_t MAX_BUCKETS = 1024;  // 4 KB of bucket table
+  static constexpr uint32_t PICK_CHUNK = 64;     // Entries per read (256 bytes)
+  static constexpr int PICK_TRIES = 8;           // Random entries tried before a full pass
+
+  RatingIndex() = default;
+  ~RatingIndex() { close(); }
+  RatingIndex(const RatingIndex&) = delete;
+  RatingIndex& operator=(const RatingIndex&) = delete;
+
+  // Fails (and stays closed) if the file is missing, malformed, or was
+  // built for a pack with a different puzzle count.
+  bool open(const std::string& path, uint32_t puzzleCount);
+  void close();
+  bool isOpen() const { return opened; }
+
+  // Lowest and highest rating the buckets cover
+  uint16_t ratingMin() const { return base; }
+  uint16_t ratingMax() const;
+
+  // The ratings pick() and countInRange() actually cover for [lo, hi]: the
+  // range rounded out to whole buckets and clipped to the index. False if
+  // no bucket overlaps it.
+  bool coveredRange(uint16_t lo, uint16_t hi, uint16_t& coveredLo, uint16_t& coveredHi) const;
+
+  // Puzzles in the buckets overlapping [lo, hi]
+  uint32_t countInRange(uint16_t lo, uint16_t hi) const;
+
+  // A puzzle rated within [lo, hi] (rounded out, see coveredRange()), other
+  // than `skip`, chosen uniformly from those not set in `solved` (nullptr =
+  // none solved) using random numbers drawn from `seed`. Tries PICK_TRIES
+  // random entries, then makes one pass over the window; a solved puzzle is
+  // returned only if the window has no unsolved one.
+  bool pick(uint16_t lo, uint16_t hi, const Bitset* solved, uint32_t skip, uint32_t seed, uint32_t& index);
+
+  // Walks the puzzles rated within [lo, hi] in index order, one range of
+  // puzzles at a time, keeping a read position in each bucket
+  struct Scan {
+    uint32_t firstBucket = 0;
+    std::vector<uint32_t> position;  // Next list position, per bucket in the window
+  };
+  void beginScan(uint16_t lo, uint16_t hi, Scan& scan) const;
+  // Set bit i of out for each puzzle first + i in the window. Calls must
+  // ask for increasing, non-overlapping ranges; after a gap each bucket is
+  // binary searched for `first` rather than read up to it.
+  bool scanRange(Scan& scan, uint32_t first, Bitset& out);
+
+ private:
+  FsFile file;
+  bool opened = false;
+  uint32_t count = 0;
+  uint16_t base = 0;
+  uint16_t width = 0;
+  std::vector<uint32_t> bucketStart;  // Bucket count + 1 list positions
+
+  void bucketRange(uint16_t lo, uint16_t hi, uint32_t& firstBucket, uint32_t& endBucket) const;
+  void listRange(uint16_t lo, uint16_t hi, uint32_t& first, uint32_t& end) const;
+  bool readEntries(uint32_t position, uint32_t* out, uint32_t n);
+  bool lowerBound(uint32_t& position, uint32_t end, uint32_t value);
+};
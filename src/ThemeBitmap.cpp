@@ -0,0 +1,178 @@
+#include "ThemeBitmap.h"
+
+#include <Arduino.h>
+#include <SDCardManager.h>
+
+#include <cstring>
+
+namespace {
+
+uint16_t readU16(const uint8_t* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+
+uint32_t readU32(const uint8_t* p) {
+  return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) |
+         (static_cast<uint32_t>(p[3]) << 24);
+}
+
+}  // namespace
+
+bool ThemeBitmap::open(const std::string& basePath, uint32_t puzzleCount) {
+  close();
+
+  if (SdMan.exists((basePath + ".rbm").c_str())) {
+    return openCompressed(basePath + ".rbm", puzzleCount);
+  }
+  return openPlain(basePath + ".bit", puzzleCount);
+}
+
+bool ThemeBitmap::openCompressed(const std::string& path, uint32_t puzzleCount) {
+  if (!SdMan.openFileForRead("CHESS", path, file)) {
+    Serial.printf("[CHESS] Failed to open theme bitmap %s\n", path.c_str());
+    return false;
+  }
+  opened = true;
+  isCompressed = true;
+  bits = puzzleCount;
+  chunks = (puzzleCount + CHUNK_BITS - 1) / CHUNK_BITS;
+
+  uint8_t header[HEADER_SIZE];
+  if (file.read(header, HEADER_SIZE) != static_cast<int>(HEADER_SIZE) || memcmp(header, "RBM1", 4) != 0 ||
+      readU32(header + 4) != puzzleCount || readU32(header + 12) != chunks || chunks > MAX_CHUNKS) {
+    Serial.printf("[CHESS] Theme bitmap %s does not match pack\n", path.c_str());
+    close();
+    return false;
+  }
+
+  std::vector<uint8_t> entries(8 * chunks);
+  if (file.read(entries.data(), entries.size()) != static_cast<int>(entries.size())) {
+    Serial.println("[CHESS] Failed to read theme bitmap directory");
+    close();
+    return false;
+  }
+
+  const uint32_t fileSize = file.size();
+  directory.resize(chunks);
+  for (uint32_t i = 0; i < chunks; i++) {
+    Container& c = directory[i];
+    c.offset = readU32(entries.data() + 8 * i);
+    c.type = readU16(entries.data() + 8 * i + 4);
+    c.count = readU16(entries.data() + 8 * i + 6);
+
+    const uint32_t chunkBits = bits - i * CHUNK_BITS < CHUNK_BITS ? bits - i * CHUNK_BITS : CHUNK_BITS;
+    uint32_t size = 0;
+    switch (c.type) {
+      case ARRAY:
+        size = c.count <= MAX_ARRAY_VALUES ? 2u * c.count : UINT32_MAX;
+        break;
+      case BITMAP:
+        size = (chunkBits + 7) / 8;
+        break;
+      case RUNS:
+        size = 4u * c.count;
+        break;
+      default:
+        size = UINT32_MAX;
+        break;
+    }
+    if (size == UINT32_MAX || c.offset > fileSize || size > fileSize - c.offset) {
+      Serial.printf("[CHESS] Theme bitmap chunk %lu is invalid\n", static_cast<unsigned long>(i));
+      close();
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ThemeBitmap::openPlain(const std::string& path, uint32_t puzzleCount) {
+  if (!SdMan.openFileForRead("CHESS", path, file)) {
+    Serial.printf("[CHESS] Failed to load theme bitset from %s\n", path.c_str());
+    return false;
+  }
+  opened = true;
+  isCompressed = false;
+  bits = puzzleCount;
+  chunks = (puzzleCount + CHUNK_BITS - 1) / CHUNK_BITS;
+
+  if (file.size() < (puzzleCount + 7) / 8) {
+    Serial.printf("[CHESS] Theme bitset size mismatch\n");
+    close();
+    return false;
+  }
+  return true;
+}
+
+void ThemeBitmap::close() {
+  if (opened) {
+    file.close();
+  }
+  opened = false;
+  isCompressed = false;
+  bits = 0;
+  chunks = 0;
+  directory.clear();
+}
+
+bool ThemeBitmap::chunkMayHaveBits(uint32_t chunk) const {
+  if (!opened || chunk >= chunks) {
+    return false;
+  }
+  return !isCompressed || directory[chunk].type != ARRAY || directory[chunk].count > 0;
+}
+
+bool ThemeBitmap::readChunk(uint32_t chunk, Bitset& out) {
+  if (!opened || chunk >= chunks) {
+    return false;
+  }
+
+  const uint32_t first = chunk * CHUNK_BITS;
+  out.resize(bits - first < CHUNK_BITS ? bits - first : CHUNK_BITS);
+  if (isCompressed) {
+    return readContainer(directory[chunk], out);
+  }
+
+  const int bytes = static_cast<int>(out.byteSize());
+  if (!file.seek(first / 8) || file.read(out.bytes(), bytes) != bytes) {
+    return false;
+  }
+  out.trim();
+  return true;
+}
+
+bool ThemeBitmap::readContainer(const Container& container, Bitset& out) {
+  if (!file.seek(container.offset)) {
+    return false;
+  }
+
+  if (container.type == BITMAP) {
+    const int bytes = static_cast<int>(out.byteSize());
+    if (file.read(out.bytes(), bytes) != bytes) {
+      return false;
+    }
+    out.trim();
+    return true;
+  }
+
+  // Arrays and runs are read through a small buffer; values are
+  // little-endian u16, read straight into the buffer as Bitset does
+  uint16_t values[256];
+  const uint32_t perValue = container.type == RUNS ? 2 : 1;
+  uint32_t remaining = container.count * perValue;
+  while (remaining > 0) {
+    const uint32_t n = remaining < 256 ? remaining : 256;
+    const int bytes = static_cast<int>(2 * n);
+    if (file.read(values, bytes) != bytes) {
+      return false;
+    }
+    if (container.type == RUNS) {
+      for (uint32_t i = 0; i < n; i += 2) {
+        out.setRange(values[i], values[i + 1] + 1u);
+      }
+    } else {
+      for (uint32_t i = 0; i < n; i++) {
+        out.set(values[i]);
+      }
+    }
+    remaining -= n;
+  }
+  return true;
+}
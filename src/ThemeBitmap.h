@@ -0,0 +1,66 @@
+#pragma once
+
+#include <SdFat.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Bitset.h"
+
+// Reads one theme's puzzles from the pack index a chunk of CHUNK_BITS
+// puzzles at a time, so RAM use depends on the chunk size and not on the
+// pack. Prefers the compressed theme_<name>.rbm (an array, bitmap or run
+// container per chunk; see tools/pack_lichess_cpz.py), and falls back to the
+// plain theme_<name>.bit bitset, read one chunk-sized slice at a time. Only
+// the .rbm chunk directory stays in RAM.
+class ThemeBitmap {
+ public:
+  static constexpr uint32_t CHUNK_BITS = 65536;
+  static constexpr uint32_t CHUNK_WORDS = CHUNK_BITS / Bitset::WORD_BITS;
+  static constexpr size_t HEADER_SIZE = 16;
+  static constexpr uint32_t MAX_CHUNKS = 1024;  // 8 KB of directory
+  static constexpr uint16_t MAX_ARRAY_VALUES = 4096;
+
+  ThemeBitmap() = default;
+  ~ThemeBitmap() { close(); }
+  ThemeBitmap(const ThemeBitmap&) = delete;
+  ThemeBitmap& operator=(const ThemeBitmap&) = delete;
+
+  // basePath is the index file path without its extension. Fails if
+  // neither file exists or the one found does not match puzzleCount.
+  bool open(const std::string& basePath, uint32_t puzzleCount);
+  void close();
+  bool isOpen() const { return opened; }
+  bool compressed() const { return isCompressed; }
+
+  uint32_t chunkCount() const { return chunks; }
+  // False when the .rbm directory shows the chunk is empty, so a query can
+  // skip it without reading; always true for .bit files
+  bool chunkMayHaveBits(uint32_t chunk) const;
+
+  // Replace out with the theme's puzzles in `chunk`: bit i is puzzle
+  // chunk * CHUNK_BITS + i, sized to the puzzles in that chunk
+  bool readChunk(uint32_t chunk, Bitset& out);
+
+ private:
+  enum ContainerType : uint16_t { ARRAY = 0, BITMAP = 1, RUNS = 2 };
+
+  struct Container {
+    uint32_t offset;
+    uint16_t type;
+    uint16_t count;  // Array values or runs
+  };
+
+  FsFile file;
+  bool opened = false;
+  bool isCompressed = false;
+  uint32_t bits = 0;
+  uint32_t chunks = 0;
+  std::vector<Container> directory;
+
+  bool openCompressed(const std::string& path, uint32_t puzzleCount);
+  bool openPlain(const std::string& path, uint32_t puzzleCount);
+  bool readContainer(const Container& container, Bitset& out);
+};
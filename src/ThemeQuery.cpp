@@ -0,0 +1,157 @@
+#include "ThemeQuery.h"
+
+#include <Arduino.h>
+
+void ThemeQuery::clear(uint32_t puzzleCount) {
+  for (int i = 0; i < terms; i++) {
+    bitmaps[i].close();
+  }
+  terms = 0;
+  bits = puzzleCount;
+  rating = nullptr;
+  ratingScan = RatingIndex::Scan();
+  exclude = nullptr;
+  result.reset();
+  scratch.reset();
+  loadedChunk = NO_CHUNK;
+  done = true;
+  returnedCount = 0;
+  evaluatedCount = 0;
+}
+
+bool ThemeQuery::addTheme(const std::string& basePath, Op op) {
+  if (terms >= MAX_TERMS || !bitmaps[terms].open(basePath, bits)) {
+    return false;
+  }
+  ops[terms++] = op;
+  return true;
+}
+
+void ThemeQuery::setRatingRange(RatingIndex* index, uint16_t lo, uint16_t hi) {
+  rating = index;
+  ratingLo = lo;
+  ratingHi = hi;
+}
+
+void ThemeQuery::start(uint32_t from) {
+  done = bits == 0;
+  startIndex = done ? 0 : from % bits;
+  nextIndex = startIndex;
+  wrapped = false;
+  loadedChunk = NO_CHUNK;
+  returnedCount = 0;
+  evaluatedCount = 0;
+  ratingNextChunk = NO_CHUNK;
+}
+
+bool ThemeQuery::next(uint32_t& index) {
+  if (!peek(index)) {
+    return false;
+  }
+  nextIndex = index + 1;
+  returnedCount++;
+  if (nextIndex >= bits) {
+    nextIndex = 0;
+    wrapped = true;
+  }
+  return true;
+}
+
+bool ThemeQuery::peek(uint32_t& index) {
+  while (!done) {
+    if (wrapped && nextIndex >= startIndex) {
+      done = true;
+      break;
+    }
+
+    const uint32_t chunk = nextIndex / ThemeBitmap::CHUNK_BITS;
+    const uint32_t first = chunk * ThemeBitmap::CHUNK_BITS;
+    if (chunk != loadedChunk && !evaluate(chunk)) {
+      Serial.printf("[CHESS] Theme query failed at chunk %d\n", chunk);
+      done = true;
+      break;
+    }
+
+    // On the second pass, stop where the first one started
+    const uint32_t limit = wrapped && startIndex < first + result.size() ? startIndex - first : result.size();
+    const uint32_t bit = result.findNext(nextIndex - first);
+    if (bit < limit) {
+      index = first + bit;
+      nextIndex = index;
+      return true;
+    }
+
+    nextIndex = first + result.size();
+    if (wrapped && nextIndex >= startIndex) {
+      done = true;
+    } else if (nextIndex >= bits) {
+      nextIndex = 0;
+      wrapped = true;
+    }
+  }
+  return false;
+}
+
+bool ThemeQuery::evaluate(uint32_t chunk) {
+  const uint32_t first = chunk * ThemeBitmap::CHUNK_BITS;
+  const uint32_t size = bits - first < ThemeBitmap::CHUNK_BITS ? bits - first : ThemeBitmap::CHUNK_BITS;
+  loadedChunk = NO_CHUNK;
+  result.resize(size);
+  evaluatedCount++;
+
+  // The .rbm directories can rule the chunk out without reading it
+  bool anyOr = false;
+  bool orMayMatch = false;
+  for (int i = 0; i < terms; i++) {
+    const bool mayHaveBits = bitmaps[i].chunkMayHaveBits(chunk);
+    if (ops[i] == Op::And && !mayHaveBits) {
+      loadedChunk = chunk;
+      return true;
+    }
+    if (ops[i] == Op::Or) {
+      anyOr = true;
+      orMayMatch = orMayMatch || mayHaveBits;
+    }
+  }
+  if (anyOr && !orMayMatch) {
+    loadedChunk = chunk;
+    return true;
+  }
+
+  if (anyOr) {
+    for (int i = 0; i < terms; i++) {
+      if (ops[i] != Op::Or) continue;
+      if (!bitmaps[i].readChunk(chunk, scratch)) return false;
+      result.unite(scratch);
+    }
+  } else {
+    result.setRange(0, size);
+  }
+  for (int i = 0; i < terms; i++) {
+    if (ops[i] == Op::Or || (ops[i] == Op::Not && !bitmaps[i].chunkMayHaveBits(chunk))) continue;
+    if (!bitmaps[i].readChunk(chunk, scratch)) return false;
+    if (ops[i] == Op::And) {
+      result.intersect(scratch);
+    } else {
+      result.andNot(scratch);
+    }
+  }
+
+  if (rating) {
+    // The scan only moves forward; start it again after wrapping around.
+    // scanRange() binary searches each bucket up to a jumped-to chunk.
+    if (ratingNextChunk == NO_CHUNK || chunk < ratingNextChunk) {
+      rating->beginScan(ratingLo, ratingHi, ratingScan);
+    }
+    ratingNextChunk = chunk + 1;
+    scratch.resize(size);
+    if (!rating->scanRange(ratingScan, first, scratch)) return false;
+    result.intersect(scratch);
+  }
+  if (exclude) {
+    result.andNot(*exclude, chunk * ThemeBitmap::CHUNK_WORDS);
+  }
+
+  loadedChunk = chunk;
+  return true;
+}
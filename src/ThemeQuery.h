@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "Bitset.h"
+#include "RatingIndex.h"
+#include "ThemeBitmap.h"
+
+// A boolean query over the theme index: puzzles with every And theme, at
+// least one Or theme (when there are any) and no Not theme, optionally
+// limited to a rating window and to unsolved puzzles. Matches come out of a
+// cursor in index order, evaluated one ThemeBitmap chunk at a time, so only
+// two chunk-sized bitsets are held however large the pack is, and the first
+// match is ready after reading a single chunk of each bitmap.
+class ThemeQuery {
+ public:
+  enum class Op : uint8_t { And, Or, Not };
+  static constexpr int MAX_TERMS = 6;
+
+  ThemeQuery() = default;
+  ThemeQuery(const ThemeQuery&) = delete;
+  ThemeQuery& operator=(const ThemeQuery&) = delete;
+
+  // Drop all terms and filters and close the bitmaps
+  void clear(uint32_t puzzleCount = 0);
+
+  // basePath as for ThemeBitmap::open(). False if the query is full or the
+  // bitmap cannot be opened.
+  bool addTheme(const std::string& basePath, Op op);
+  // Limit to ratings within [lo, hi]; the index must stay open while the
+  // query is used
+  void setRatingRange(RatingIndex* index, uint16_t lo, uint16_t hi);
+  // Leave out puzzles set in solved, which must outlive the query
+  void setExclude(const Bitset* solved) { exclude = solved; }
+
+  int termCount() const { return terms; }
+
+  // Restart the cursor at puzzle `from`; it wraps around once
+  void start(uint32_t from);
+  // Next match, or false once the cursor is back at its start
+  bool next(uint32_t& index);
+  // The match next() would return, leaving the cursor on it
+  bool peek(uint32_t& index);
+  // Matches returned since start()
+  uint32_t returned() const { return returnedCount; }
+  uint32_t chunksEvaluated() const { return evaluatedCount; }
+
+ private:
+  static constexpr uint32_t NO_CHUNK = UINT32_MAX;
+
+  ThemeBitmap bitmaps[MAX_TERMS];
+  Op ops[MAX_TERMS] = {};
+  int terms = 0;
+  uint32_t bits = 0;
+
+  RatingIndex* rating = nullptr;
+  uint16_t ratingLo = 0;
+  uint16_t ratingHi = 0;
+  RatingIndex::Scan ratingScan;
+  uint32_t ratingNextChunk = 0;  // The scan cannot go back past this
+
+  const Bitset* exclude = nullptr;
+
+  Bitset result;   // Matches in loadedChunk
+  Bitset scratch;  // One term's chunk
+  uint32_t loadedChunk = NO_CHUNK;
+
+  uint32_t startIndex = 0;
+  uint32_t nextIndex = 0;
+  bool wrapped = false;
+  bool done = true;
+  uint32_t returnedCount = 0;
+  uint32_t evaluatedCount = 0;
+
+  bool evaluate(uint32_t chunk);
+};
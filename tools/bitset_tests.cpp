@@ -0,0 +1,216 @@
+// Host-side checks for Bitset and BitsetIndex.
+//
+// Fills bitsets with random patterns of several densities and compares the
+// word-at-a-time operations with a per-bit reference, and the index with a
+// brute-force one built from test(). Run by ctest.
+//
+//   bitset_tests
+
+#include "Bitset.h"
+#include "BitsetIndex.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const char* what, uint32_t size, uint32_t at) {
+    if (ok) return;
+    if (failures < 20) {
+        printf("  FAILED: %s (size %u, at %u)\n", what, size, at);
+    }
+    failures++;
+}
+
+// Sizes around the word and BitsetIndex block boundaries
+const uint32_t SIZES[] = {0, 1, 31, 32, 33, 100, 2047, 2048, 2049, 5000, 65536, 70001};
+
+// Set roughly perMille / 1000 of the bits
+void fill(Bitset& bits, uint32_t size, uint32_t perMille, std::mt19937& rng) {
+    bits.resize(size);
+    for (uint32_t i = 0; i < size; i++) {
+        if (rng() % 1000 < perMille) bits.set(i);
+    }
+}
+
+// Indices set in include and clear in exclude, in order
+std::vector<uint32_t> selected(const Bitset* include, const Bitset* exclude, uint32_t size) {
+    std::vector<uint32_t> out;
+    for (uint32_t i = 0; i < size; i++) {
+        if ((!include || include->test(i)) && (!exclude || !exclude->test(i))) out.push_back(i);
+    }
+    return out;
+}
+
+std::vector<bool> bitsOf(const Bitset& bits) {
+    std::vector<bool> out(bits.size());
+    for (uint32_t i = 0; i < bits.size(); i++) {
+        out[i] = bits.test(i);
+    }
+    return out;
+}
+
+void checkBits(const Bitset& bits, const std::vector<bool>& expected, const char* what) {
+    const uint32_t size = static_cast<uint32_t>(expected.size());
+    check(bits.size() == size, what, size, 0);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < size; i++) {
+        check(bits.test(i) == expected[i], what, size, i);
+        count += expected[i];
+    }
+    check(bits.count() == count, what, size, size);
+    // Nothing may leak into the unused top of the last word
+    if (size % Bitset::WORD_BITS) {
+        check((bits.word(bits.wordCount() - 1) >> (size % Bitset::WORD_BITS)) == 0, what, size, size);
+    }
+}
+
+void testBitset(std::mt19937& rng) {
+    const uint32_t sizes[] = {1, 5, 31, 32, 33, 63, 64, 65, 100, 1000, 4097};
+    const uint32_t densities[] = {0, 100, 500, 900, 1000};
+    for (uint32_t size : sizes) {
+        for (uint32_t density : densities) {
+            Bitset a;
+            fill(a, size, density, rng);
+            const std::vector<bool> ref = bitsOf(a);
+            checkBits(a, ref, "count");
+
+            // Other operand the same size, shorter and longer
+            const uint32_t otherSizes[] = {size, size / 2, size + 40};
+            for (uint32_t otherSize : otherSizes) {
+                Bitset b;
+                fill(b, otherSize, 500, rng);
+
+                std::vector<bool> expected(size);
+                for (uint32_t i = 0; i < size; i++) expected[i] = ref[i] && b.test(i);
+                Bitset both = a;
+                both.intersect(b);
+                checkBits(both, expected, "intersect");
+
+                for (uint32_t i = 0; i < size; i++) expected[i] = ref[i] || b.test(i);
+                Bitset either = a;
+                either.unite(b);
+                checkBits(either, expected, "unite");
+            }
+
+            const uint32_t offsets[] = {0, 1, 3};
+            for (uint32_t otherWord : offsets) {
+                // Sometimes ends before the slice does; the rest counts as clear
+                const uint32_t base = otherWord * Bitset::WORD_BITS;
+                Bitset b;
+                fill(b, base + rng() % (size + 40), 500, rng);
+
+                std::vector<bool> expected(size);
+                uint32_t count = 0;
+                for (uint32_t i = 0; i < size; i++) {
+                    expected[i] = ref[i] && !b.test(base + i);
+                    count += expected[i];
+                }
+                check(a.countAndNot(b, otherWord) == count, "countAndNot", size, otherWord);
+                Bitset rest = a;
+                rest.andNot(b, otherWord);
+                checkBits(rest, expected, "andNot");
+            }
+
+            for (uint32_t from = 0; from <= size; from += 1 + rng() % 40) {
+                uint32_t expected = from;
+                while (expected < size && !ref[expected]) expected++;
+                check(a.findNext(from) == expected, "findNext", size, from);
+            }
+
+            const uint32_t from = rng() % (size + 8);
+            const uint32_t count = rng() % (size + 40);
+            std::vector<bool> expected = ref;
+            for (uint32_t i = from; i < size && i - from < count; i++) expected[i] = true;
+            Bitset ranged = a;
+            ranged.setRange(from, count);
+            checkBits(ranged, expected, "setRange");
+
+            // Bits past size() in a file image are dropped by trim()
+            Bitset image;
+            image.resize(size);
+            for (uint32_t i = 0; i < image.wordCount() * 4; i++) {
+                image.bytes()[i] = 0xFF;
+            }
+            image.trim();
+            checkBits(image, std::vector<bool>(size, true), "trim");
+
+            Bitset cleared = a;
+            cleared.clearAll();
+            checkBits(cleared, std::vector<bool>(size), "clearAll");
+        }
+    }
+}
+
+void checkIndex(const BitsetIndex& index, const std::vector<uint32_t>& expected, uint32_t size) {
+    check(index.count() == expected.size(), "count", size, 0);
+    check(index.empty() == expected.empty(), "empty", size, 0);
+
+    uint32_t rank = 0;
+    for (uint32_t i = 0; i <= size; i++) {
+        const bool in = rank < expected.size() && expected[rank] == i;
+        check(index.rank(i) == rank, "rank", size, i);
+        if (i < size) check(index.contains(i) == in, "contains", size, i);
+        if (in) rank++;
+    }
+
+    for (uint32_t k = 0; k < expected.size(); k++) {
+        uint32_t found = UINT32_MAX;
+        check(index.select(k, found) && found == expected[k], "select", size, k);
+    }
+    uint32_t found = 0;
+    check(!index.select(static_cast<uint32_t>(expected.size()), found), "select past count", size, 0);
+}
+
+void testIndex(std::mt19937& rng) {
+    const uint32_t densities[] = {0, 5, 500, 995, 1000};
+    for (uint32_t size : SIZES) {
+        for (uint32_t density : densities) {
+            Bitset include;
+            Bitset exclude;
+            fill(include, size, density, rng);
+            fill(exclude, size, 300, rng);
+
+            BitsetIndex all;
+            all.build(nullptr, nullptr, size);
+            checkIndex(all, selected(nullptr, nullptr, size), size);
+
+            BitsetIndex included;
+            included.build(&include, nullptr, size);
+            checkIndex(included, selected(&include, nullptr, size), size);
+
+            BitsetIndex index;
+            index.build(&include, &exclude, size);
+            std::vector<uint32_t> expected = selected(&include, &exclude, size);
+            checkIndex(index, expected, size);
+
+            // Solve puzzles one at a time, as the app does, checking after each
+            for (int step = 0; step < 8 && !expected.empty(); step++) {
+                const size_t pos = rng() % expected.size();
+                exclude.set(expected[pos]);
+                index.remove(expected[pos]);
+                expected.erase(expected.begin() + pos);
+                checkIndex(index, expected, size);
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main() {
+    std::mt19937 rng(12345);
+
+    testBitset(rng);
+    printf("bitset: %s\n", failures == 0 ? "ok" : "FAILED");
+    const int bitsetFailures = failures;
+
+    testIndex(rng);
+    printf("bitset index: %s\n", failures == bitsetFailures ? "ok" : "FAILED");
+
+    return failures == 0 ? 0 : 1;
+}
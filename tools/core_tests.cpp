@@ -0,0 +1,180 @@
+// Host-side checks for BoardState's game-end rules and the transposition table.
+//
+// Checks gameStatus() on positions where the fifty-move rule applies, with
+// and without mate or stalemate on the board, and isInsufficientMaterial()
+// on the drawn and not-quite-drawn minor piece endings. Then fills single
+// table buckets to check what a store keeps and what it evicts across
+// searches. Run by ctest.
+//
+//   core_tests
+
+#include "ChessCore.h"
+#include "ChessTT.h"
+#include "fen.h"
+
+#include <cstdio>
+#include <string>
+
+using Chess::BoardState;
+using Chess::GameStatus;
+using Chess::Move;
+using Chess::TranspositionTable;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    printf("  FAILED: %s\n", what.c_str());
+    failures++;
+}
+
+void testGameStatus() {
+    struct Case {
+        const char* fen;
+        GameStatus expected;
+    };
+    const Case cases[] = {
+        {"4k3/8/8/8/8/8/4P3/R3K3 w - - 99 80", GameStatus::Ongoing},
+        {"4k3/8/8/8/8/8/4P3/R3K3 w - - 100 80", GameStatus::FiftyMoveRule},
+        // Mate and stalemate on the hundredth half-move still count
+        {"R5k1/5ppp/8/8/8/8/8/6K1 b - - 100 80", GameStatus::Checkmate},
+        {"7k/5Q2/6K1/8/8/8/8/8 b - - 100 80", GameStatus::Stalemate},
+        {"R5k1/5ppp/8/8/8/8/8/6K1 b - - 0 80", GameStatus::Checkmate},
+        {"4k3/8/8/8/8/8/8/2B1K3 w - - 0 80", GameStatus::InsufficientMaterial},
+    };
+
+    for (const Case& c : cases) {
+        BoardState state;
+        if (!parseFen(c.fen, state)) {
+            check(false, std::string("bad FEN ") + c.fen);
+            continue;
+        }
+        const GameStatus status = state.gameStatus();
+        check(status == c.expected, std::string(c.fen) + ": status " + std::to_string(static_cast<int>(status)));
+    }
+}
+
+void testInsufficientMaterial() {
+    struct Case {
+        const char* fen;
+        bool expected;
+    };
+    const Case cases[] = {
+        {"4k3/8/8/8/8/8/8/4K3 w - - 0 1", true},      // KK
+        {"4k3/8/8/8/8/8/8/1N2K3 w - - 0 1", true},    // KNK
+        {"4k3/8/8/8/8/8/8/2B1K3 w - - 0 1", true},    // KBK
+        {"4kb2/8/8/8/8/8/8/2B1K3 w - - 0 1", true},   // KBKB, both on dark squares
+        {"2b1k3/8/8/8/8/8/8/2B1K3 w - - 0 1", false}, // KBKB, opposite colors
+        {"4k3/8/8/8/8/8/8/1N2KN2 w - - 0 1", false},  // KNNK
+        {"4k3/8/8/8/8/8/8/1N2KB2 w - - 0 1", false},  // KBNK
+        {"4k3/8/8/8/8/8/4P3/4K3 w - - 0 1", false},   // KPK
+        {"4k3/8/8/8/8/8/8/R3K3 w - - 0 1", false},    // KRK
+    };
+
+    for (const Case& c : cases) {
+        BoardState state;
+        if (!parseFen(c.fen, state)) {
+            check(false, std::string("bad FEN ") + c.fen);
+            continue;
+        }
+        check(state.isInsufficientMaterial() == c.expected, c.fen);
+    }
+}
+
+// Key landing in `bucket` whose top 16 bits, the entry's check, are `id`
+uint64_t keyFor(uint16_t id, uint64_t bucket) { return (static_cast<uint64_t>(id) << 48) | bucket; }
+
+bool holds(TranspositionTable& tt, uint64_t key) { return tt.probe(key) != nullptr; }
+
+void testTable() {
+    TranspositionTable tt;
+    if (!tt.resize(64 * 32)) {
+        check(false, "tt: resize");
+        return;
+    }
+    check(tt.capacity() == 64 * TranspositionTable::BUCKET_SIZE, "tt: capacity");
+
+    // Probe after store returns what was stored
+    const Move move(12, 28);
+    tt.store(keyFor(1, 5), 7, -123, Chess::TT_LOWER, move);
+    const Chess::TTEntry* entry = tt.probe(keyFor(1, 5));
+    check(entry && entry->depth == 7 && entry->score == -123 && entry->bound() == Chess::TT_LOWER &&
+              entry->bestMove() == move,
+          "tt: probe after store");
+    check(!holds(tt, keyFor(2, 5)), "tt: hit on another check in the same bucket");
+    check(!holds(tt, keyFor(1, 6)), "tt: hit in another bucket");
+
+    // Same position in the same search: a shallower bound keeps the deeper entry
+    tt.store(keyFor(1, 5), 3, 40, Chess::TT_UPPER, Move());
+    entry = tt.probe(keyFor(1, 5));
+    check(entry && entry->depth == 7 && entry->score == -123, "tt: deeper entry replaced by a shallower bound");
+    // ...but an exact score replaces it, keeping the best move if none is given
+    tt.store(keyFor(1, 5), 3, 40, Chess::TT_EXACT, Move());
+    entry = tt.probe(keyFor(1, 5));
+    check(entry && entry->depth == 3 && entry->score == 40 && entry->bestMove() == move,
+          "tt: exact store of the same position");
+    // ...and so does any result from a later search
+    tt.newSearch();
+    tt.store(keyFor(1, 6), 9, 0, Chess::TT_EXACT, Move());
+    tt.newSearch();
+    tt.store(keyFor(1, 6), 2, 15, Chess::TT_UPPER, Move());
+    entry = tt.probe(keyFor(1, 6));
+    check(entry && entry->depth == 2 && entry->score == 15, "tt: stale entry kept over a new search's");
+
+    // A full bucket in one search gives up its shallowest entry
+    tt.clear();
+    const int depths[TranspositionTable::BUCKET_SIZE] = {10, 2, 6, 8};
+    for (int i = 0; i < TranspositionTable::BUCKET_SIZE; i++) {
+        tt.store(keyFor(i + 1, 3), depths[i], 0, Chess::TT_EXACT, Move());
+    }
+    for (int i = 0; i < TranspositionTable::BUCKET_SIZE; i++) {
+        check(holds(tt, keyFor(i + 1, 3)), "tt: bucket does not hold " + std::to_string(i + 1));
+    }
+    const uint32_t replacements = tt.stats().replacements;
+    tt.store(keyFor(5, 3), 1, 0, Chess::TT_EXACT, Move());
+    check(tt.stats().replacements == replacements + 1, "tt: replacement not counted");
+    check(holds(tt, keyFor(5, 3)), "tt: new entry not stored");
+    check(!holds(tt, keyFor(2, 3)), "tt: shallowest entry kept");
+    check(holds(tt, keyFor(1, 3)) && holds(tt, keyFor(3, 3)) && holds(tt, keyFor(4, 3)), "tt: deeper entry evicted");
+
+    // Across searches, a deep entry nobody probed gives way to shallow new
+    // ones; probing an entry keeps it current, even a shallower one
+    tt.clear();
+    tt.store(keyFor(1, 9), 8, 0, Chess::TT_EXACT, Move());
+    tt.store(keyFor(2, 9), 9, 0, Chess::TT_EXACT, Move());
+    tt.newSearch();
+    tt.newSearch();
+    tt.store(keyFor(3, 9), 1, 0, Chess::TT_EXACT, Move());
+    tt.store(keyFor(4, 9), 2, 0, Chess::TT_EXACT, Move());
+    check(holds(tt, keyFor(1, 9)), "tt: old entry lost before the bucket filled");
+    tt.store(keyFor(5, 9), 3, 0, Chess::TT_EXACT, Move());
+    check(!holds(tt, keyFor(2, 9)), "tt: old unprobed entry kept");
+    check(holds(tt, keyFor(1, 9)), "tt: probed entry evicted");
+    check(holds(tt, keyFor(3, 9)) && holds(tt, keyFor(4, 9)) && holds(tt, keyFor(5, 9)),
+          "tt: current entry evicted");
+
+    // The generation wraps after 64 searches; ages still compare
+    tt.clear();
+    for (int i = 0; i < 70; i++) tt.newSearch();
+    tt.store(keyFor(1, 11), 9, 0, Chess::TT_EXACT, Move());
+    tt.newSearch();
+    tt.store(keyFor(1, 11), 2, 0, Chess::TT_UPPER, Move());
+    entry = tt.probe(keyFor(1, 11));
+    check(entry && entry->depth == 2, "tt: age lost across the generation wrap");
+}
+
+}  // namespace
+
+int main() {
+    testGameStatus();
+    testInsufficientMaterial();
+    printf("game status: %s\n", failures == 0 ? "ok" : "FAILED");
+    const int statusFailures = failures;
+
+    testTable();
+    printf("transposition table: %s\n", failures == statusFailures ? "ok" : "FAILED");
+
+    return failures == 0 ? 0 : 1;
+}
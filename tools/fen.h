@@ -0,0 +1,76 @@
+// FEN parsing and UCI move text for the host tools and tests.
+#pragma once
+
+#include "ChessCore.h"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Minimal FEN reader: placement, side, castling, ep, clocks
+inline bool parseFen(const char* fen, Chess::BoardState& out) {
+    Chess::BoardState state;
+    for (int sq = 0; sq < 64; sq++) {
+        state.board[sq] = Chess::NONE;
+    }
+
+    const char* p = fen;
+    int rank = 7;
+    int file = 0;
+    for (; *p && *p != ' '; ++p) {
+        if (*p == '/') {
+            rank--;
+            file = 0;
+        } else if (*p >= '1' && *p <= '8') {
+            file += *p - '0';
+        } else {
+            const char* pieces = " PNBRQKpnbrqk";
+            const char* found = strchr(pieces, *p);
+            if (!found || *p == ' ' || file > 7 || rank < 0) return false;
+            state.board[rank * 8 + file] = static_cast<Chess::Piece>(found - pieces);
+            file++;
+        }
+    }
+    if (*p++ != ' ') return false;
+
+    state.whiteToMove = (*p == 'w');
+    p++;
+    if (*p++ != ' ') return false;
+
+    state.castling = 0;
+    for (; *p && *p != ' '; ++p) {
+        if (*p == 'K') state.castling |= 1;
+        else if (*p == 'Q') state.castling |= 2;
+        else if (*p == 'k') state.castling |= 4;
+        else if (*p == 'q') state.castling |= 8;
+    }
+    if (*p == ' ') p++;
+
+    state.epSquare = -1;
+    if (*p && *p != '-') {
+        state.epSquare = Chess::BoardState::makeSquare(p[0] - 'a', p[1] - '1');
+        p += 2;
+    } else if (*p) {
+        p++;
+    }
+
+    int halfmove = 0;
+    int fullmove = 1;
+    sscanf(p, "%d %d", &halfmove, &fullmove);
+    state.halfmoveClock = static_cast<uint8_t>(halfmove);
+    state.fullmoveNum = static_cast<uint16_t>(fullmove);
+
+    state.rebuildDerivedState();
+    out = state;
+    return true;
+}
+
+inline std::string moveToUci(const Chess::Move& m) {
+    std::string s;
+    s += static_cast<char>('a' + Chess::BoardState::fileOf(m.from()));
+    s += static_cast<char>('1' + Chess::BoardState::rankOf(m.from()));
+    s += static_cast<char>('a' + Chess::BoardState::fileOf(m.to()));
+    s += static_cast<char>('1' + Chess::BoardState::rankOf(m.to()));
+    if (m.promo() > 0) s += " nbrq"[m.promo()];
+    return s;
+}
@@ -0,0 +1,17 @@
+// Host stand-in for the Arduino core: Serial logs to stdout. Test builds only.
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+
+struct HostSerial {
+  void println(const char* text) { std::printf("%s\n", text); }
+  __attribute__((format(printf, 2, 3))) void printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    std::vprintf(format, args);
+    va_end(args);
+  }
+};
+
+inline HostSerial Serial;
@@ -0,0 +1,44 @@
+// Host stand-in for the firmware's SD card manager. Paths are host paths;
+// files added with addFile() shadow them, and removeFile() hides one, so a
+// test can serve generated files or make one look missing. Test builds only.
+#pragma once
+
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <SdFat.h>
+
+class SDCardManager {
+ public:
+  void addFile(const std::string& path, std::vector<uint8_t> contents) {
+    files[path] = std::make_shared<const std::vector<uint8_t>>(std::move(contents));
+  }
+  void removeFile(const std::string& path) { files[path] = nullptr; }
+  void reset() { files.clear(); }
+
+  bool exists(const char* path) { return load(path) != nullptr; }
+
+  bool openFileForRead(const char* /*tag*/, const std::string& path, FsFile& file) {
+    auto contents = load(path);
+    file = contents ? FsFile(contents) : FsFile();
+    return contents != nullptr;
+  }
+
+ private:
+  std::map<std::string, std::shared_ptr<const std::vector<uint8_t>>> files;
+
+  std::shared_ptr<const std::vector<uint8_t>> load(const std::string& path) {
+    auto found = files.find(path);
+    if (found != files.end()) return found->second;
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return nullptr;
+    return std::make_shared<const std::vector<uint8_t>>(std::istreambuf_iterator<char>(in),
+                                                        std::istreambuf_iterator<char>());
+  }
+};
+
+inline SDCardManager SdMan;
@@ -0,0 +1,39 @@
+// Host stand-in for the part of SdFat's FsFile the index readers use, backed
+// by a byte buffer. Test builds only; see SDCardManager.h.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+class FsFile {
+ public:
+  FsFile() = default;
+  explicit FsFile(std::shared_ptr<const std::vector<uint8_t>> contents) : data(std::move(contents)) {}
+
+  explicit operator bool() const { return data != nullptr; }
+
+  int read(void* buf, size_t n) {
+    if (!data) return -1;
+    if (n > data->size() - pos) n = data->size() - pos;
+    memcpy(buf, data->data() + pos, n);
+    pos += n;
+    return static_cast<int>(n);
+  }
+  bool seek(uint32_t position) {
+    if (!data || position > data->size()) return false;
+    pos = position;
+    return true;
+  }
+  uint32_t size() const { return data ? static_cast<uint32_t>(data->size()) : 0; }
+  void close() {
+    data.reset();
+    pos = 0;
+  }
+
+ private:
+  std::shared_ptr<const std::vector<uint8_t>> data;
+  size_t pos = 0;
+};
@@ -1,6 +1,6 @@
 #!/usr/bin/env python3
 # pyright: basic
-"""Inspect CPZ1 puzzle pack headers and first record."""
+"""Inspect CPZ1/CPZ2 puzzle pack headers and first record, or a rating.idx or .rbm index file."""
 
 from __future__ import annotations
 
@@ -11,11 +11,16 @@ import sys
 
 
 HEADER_SIZE = 18
+CPZ2_HEADER_SIZE = 32
+RATING_INDEX_HEADER_SIZE = 16
+RBM_HEADER_SIZE = 16
+RBM_CHUNK_BITS = 65536
+RBM_CONTAINER_NAMES = ("array", "bitmap", "runs")
 
 
 def parse_args() -> argparse.Namespace:
-    parser = argparse.ArgumentParser(description="Inspect a CPZ1 file")
-    parser.add_argument("path", help="Path to .cpz file")
+    parser = argparse.ArgumentParser(description="Inspect a CPZ1 or CPZ2 file, a rating index or a theme bitmap")
+    parser.add_argument("path", help="Path to .cpz, rating.idx or theme_*.rbm file")
     return parser.parse_args()
 
 
@@ -23,16 +28,55 @@ def decode_text_field(blob: bytes) -> str:
     return blob.split(b"\x00", 1)[0].decode("ascii", errors="ignore")
 
 
-def main() -> None:
-    args = parse_args()
-    path = pathlib.Path(args.path)
-    data = path.read_bytes()
+def read_varint(data: bytes, pos: int) -> tuple[int, int]:
+    value = 0
+    shift = 0
+    while True:
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
 
-    if len(data) < HEADER_SIZE:
-        raise SystemExit("File too small for CPZ header")
-    if data[0:4] != b"CPZ1":
-        raise SystemExit("Not a CPZ1 file (magic mismatch)")
 
+def expand_record(data: bytes, pos: int) -> tuple[dict, int]:
+    """Decode the packed CPZ2 record at pos; returns (fields, next pos)."""
+    flags = data[pos]
+    move_count = data[pos + 1]
+    rating, pos = read_varint(data, pos + 2)
+
+    occupancy = struct.unpack_from("<Q", data, pos)[0]
+    pos += 8 + (bin(occupancy).count("1") + 1) // 2 + move_count * 2
+    theme_mask, pos = read_varint(data, pos)
+    opening_id, pos = read_varint(data, pos)
+    fields = {
+        "rating": rating,
+        "flags": flags,
+        "move_count": move_count,
+        "theme_mask": theme_mask,
+        "opening_id": opening_id,
+    }
+    return fields, pos
+
+
+def read_string_table(data: bytes, pos: int) -> tuple[list[str], list[str]]:
+    def names(pos: int, count: int) -> tuple[list[str], int]:
+        out = []
+        for _ in range(count):
+            length = data[pos]
+            out.append(data[pos + 1 : pos + 1 + length].decode("ascii", errors="ignore"))
+            pos += 1 + length
+        return out, pos
+
+    themes, pos = names(pos + 1, data[pos])
+    openings, pos = names(pos + 2, struct.unpack_from("<H", data, pos)[0])
+    if pos != len(data):
+        raise SystemExit("String table does not end at end of file")
+    return themes, openings
+
+
+def inspect_v1(path: pathlib.Path, data: bytes) -> tuple[bytes | None, int]:
     record_size = struct.unpack_from("<H", data, 4)[0]
     puzzle_count = struct.unpack_from("<I", data, 6)[0]
     rating_min = struct.unpack_from("<H", data, 10)[0]
@@ -40,6 +84,7 @@ def main() -> None:
     reserved = data[14:18]
 
     print(f"Path: {path}")
+    print("Format: CPZ1")
     print(f"Record size: {record_size}")
     print(f"Puzzle count: {puzzle_count}")
     print(f"Rating min/max: {rating_min}/{rating_max}")
@@ -51,9 +96,161 @@ def main() -> None:
         raise SystemExit("Size mismatch vs header")
 
     if puzzle_count == 0:
+        return None, record_size
+    return data[HEADER_SIZE : HEADER_SIZE + record_size], record_size
+
+
+def inspect_v2(path: pathlib.Path, data: bytes) -> None:
+    if len(data) < CPZ2_HEADER_SIZE:
+        raise SystemExit("File too small for CPZ2 header")
+
+    puzzle_count = struct.unpack_from("<I", data, 6)[0]
+    rating_min = struct.unpack_from("<H", data, 10)[0]
+    rating_max = struct.unpack_from("<H", data, 12)[0]
+    block_records = struct.unpack_from("<H", data, 14)[0]
+    block_count = struct.unpack_from("<I", data, 16)[0]
+    index_offset = struct.unpack_from("<I", data, 20)[0]
+    strings_offset = struct.unpack_from("<I", data, 24)[0]
+
+    print(f"Path: {path}")
+    print("Format: CPZ2")
+    print(f"Puzzle count: {puzzle_count}")
+    print(f"Rating min/max: {rating_min}/{rating_max}")
+    print(f"Blocks: {block_count} x {block_records} records (index at {index_offset})")
+
+    if block_records == 0 or block_count != (puzzle_count + block_records - 1) // block_records:
+        raise SystemExit("Block count does not match puzzle count")
+    offsets = struct.unpack_from(f"<{block_count + 1}I", data, index_offset)
+    print(f"File size: {len(data)} (data ends at {offsets[-1]}, strings at {strings_offset})")
+    if offsets[-1] != strings_offset:
+        raise SystemExit("Block index does not end at the string table")
+    themes, openings = read_string_table(data, strings_offset)
+    print(f"Strings: {len(themes)} themes, {len(openings)} openings ({len(data) - strings_offset} bytes)")
+    if puzzle_count:
+        print(f"Average packed record: {(offsets[-1] - offsets[0]) / puzzle_count:.1f} bytes")
+
+    pos = offsets[0]
+    for block in range(block_count):
+        records = min(block_records, puzzle_count - block * block_records)
+        for _ in range(records):
+            fields, pos = expand_record(data, pos)
+            if fields["opening_id"] > len(openings) or fields["theme_mask"] >> len(themes):
+                raise SystemExit(f"Block {block} refers to a missing string")
+        if pos != offsets[block + 1]:
+            raise SystemExit(f"Block {block} does not decode to its indexed size")
+
+    if puzzle_count == 0:
+        return
+
+    first, _ = expand_record(data, offsets[0])
+    first_themes = [t for i, t in enumerate(themes) if first["theme_mask"] >> i & 1]
+    opening_id = first["opening_id"]
+    print(f"First record rating: {first['rating']}")
+    print(f"First record move count: {first['move_count']}")
+    print(f"First record themes: {','.join(first_themes)}")
+    print(f"First record opening: {openings[opening_id - 1] if opening_id else ''}")
+
+
+def inspect_rating_index(path: pathlib.Path, data: bytes) -> None:
+    if len(data) < RATING_INDEX_HEADER_SIZE:
+        raise SystemExit("File too small for rating index header")
+
+    puzzle_count = struct.unpack_from("<I", data, 4)[0]
+    base, width, bucket_count = struct.unpack_from("<HHH", data, 8)
+    print(f"Path: {path}")
+    print("Format: RIX1 rating index")
+    print(f"Puzzle count: {puzzle_count}")
+    print(f"Buckets: {bucket_count} x {width} rating points from {base}")
+
+    list_offset = RATING_INDEX_HEADER_SIZE + 4 * (bucket_count + 1)
+    if len(data) != list_offset + 4 * puzzle_count:
+        raise SystemExit("Rating index size does not match puzzle count")
+    starts = struct.unpack_from(f"<{bucket_count + 1}I", data, RATING_INDEX_HEADER_SIZE)
+    if starts[0] != 0 or starts[-1] != puzzle_count or list(starts) != sorted(starts):
+        raise SystemExit("Rating bucket table is inconsistent")
+    order = struct.unpack_from(f"<{puzzle_count}I", data, list_offset)
+    if sorted(order) != list(range(puzzle_count)):
+        raise SystemExit("Rating index is not a permutation of the pack")
+    for bucket in range(bucket_count):
+        members = order[starts[bucket] : starts[bucket + 1]]
+        if list(members) != sorted(members):
+            raise SystemExit(f"Rating bucket {base + bucket * width} is not in puzzle order")
+
+    if bucket_count:
+        busiest = max(range(bucket_count), key=lambda b: starts[b + 1] - starts[b])
+        print(f"Largest bucket: {base + busiest * width} ({starts[busiest + 1] - starts[busiest]} puzzles)")
+
+
+def inspect_theme_bitmap(path: pathlib.Path, data: bytes) -> None:
+    if len(data) < RBM_HEADER_SIZE:
+        raise SystemExit("File too small for theme bitmap header")
+
+    puzzle_count, member_count, chunk_count = struct.unpack_from("<III", data, 4)
+    print(f"Path: {path}")
+    print("Format: RBM1 theme bitmap")
+    print(f"Puzzles: {member_count} of {puzzle_count}")
+    if chunk_count != (puzzle_count + RBM_CHUNK_BITS - 1) // RBM_CHUNK_BITS:
+        raise SystemExit("Chunk count does not match puzzle count")
+
+    kinds = [0] * len(RBM_CONTAINER_NAMES)
+    total = 0
+    expected = RBM_HEADER_SIZE + 8 * chunk_count
+    for chunk in range(chunk_count):
+        offset, kind, count = struct.unpack_from("<IHH", data, RBM_HEADER_SIZE + 8 * chunk)
+        chunk_bits = min(RBM_CHUNK_BITS, puzzle_count - chunk * RBM_CHUNK_BITS)
+        if offset != expected or kind >= len(RBM_CONTAINER_NAMES):
+            raise SystemExit(f"Chunk {chunk} has a bad directory entry")
+        if kind == 0:
+            values = struct.unpack_from(f"<{count}H", data, offset)
+            if list(values) != sorted(set(values)) or (values and values[-1] >= chunk_bits):
+                raise SystemExit(f"Chunk {chunk} array is not sorted or out of range")
+            total += count
+            expected += 2 * count
+        elif kind == 1:
+            size = (chunk_bits + 7) // 8
+            total += sum(bin(b).count("1") for b in data[offset : offset + size])
+            expected += size
+        else:
+            end = 0
+            for i in range(count):
+                start, length = struct.unpack_from("<HH", data, offset + 4 * i)
+                if start < end or start + length >= chunk_bits:
+                    raise SystemExit(f"Chunk {chunk} runs overlap or run past the chunk")
+                end = start + length + 1
+                total += length + 1
+            expected += 4 * count
+        kinds[kind] += 1
+
+    if expected != len(data) or total != member_count:
+        raise SystemExit("Theme bitmap size or count is inconsistent")
+    summary = ", ".join(f"{n} {name}" for n, name in zip(kinds, RBM_CONTAINER_NAMES) if n)
+    print(f"Chunks: {chunk_count} ({summary})")
+    print(f"File size: {len(data)} (plain bitset: {(puzzle_count + 7) // 8})")
+
+
+def main() -> None:
+    args = parse_args()
+    path = pathlib.Path(args.path)
+    data = path.read_bytes()
+
+    if len(data) < HEADER_SIZE:
+        raise SystemExit("File too small for CPZ header")
+    if data[0:4] == b"CPZ2":
+        inspect_v2(path, data)
+        return
+    if data[0:4] == b"RIX1":
+        inspect_rating_index(path, data)
+        return
+    if data[0:4] == b"RBM1":
+        inspect_theme_bitmap(path, data)
+        return
+    if data[0:4] != b"CPZ1":
+        raise SystemExit("Not a CPZ file (magic mismatch)")
+
+    first, record_size = inspect_v1(path, data)
+    if first is None:
         return
 
-    first = data[HEADER_SIZE : HEADER_SIZE + record_size]
     rating = struct.unpack_from("<H", first, 0)[0]
     move_count = first[3]
     print(f"First record rating: {rating}")
@@ -1,11 +1,55 @@
 #!/usr/bin/env python3
 # pyright: basic
-"""Pack chess puzzles into CPZ1 format with 128-byte records.
+"""Pack chess puzzles into CPZ1 (128-byte records) or CPZ2 (compressed blocks).
 
 Supports:
 - Lichess CSV input (lichess_db_puzzle.csv)
 - Built-in handcrafted starter pack (--starter)
-- Theme bitset index generation under assets/index/<packName>/
+- Theme index generation under assets/index/<packName>/ (compressed .rbm
+  bitmaps, plain .bit bitsets, or both)
+- Rating index (rating.idx) in the same directory
+
+CPZ1 record (128 bytes):
+  0  u16 rating          4  32 bytes board nibbles   84  themes, 32 bytes NUL-padded
+  2  u8 flags            36 24 x u16 moves           116 opening, 12 bytes NUL-padded
+  3  u8 move count
+
+CPZ2 header (32 bytes, little-endian):
+  0  "CPZ2"   4  u16 record size (128)   6  u32 puzzle count   10 u16 rating min
+  12 u16 rating max   14 u16 records per block   16 u32 block count
+  20 u32 index offset   24 u32 string table offset   28 reserved
+The index holds block count + 1 u32 file offsets; the last marks the end of
+the data. Each block is its records packed back to back, with no state
+shared between blocks. A packed record is the CPZ1 record without padding,
+with themes and opening interned:
+  u8 flags, u8 move count, varint rating, u64 occupancy, one nibble per
+  occupied square (ascending, low nibble first), move count x u16 moves,
+  varint theme mask, varint opening id
+The string table runs from the offset at header byte 24 to the end of the
+file: u8 theme count, then u8 length + name per theme (theme i is mask bit
+i), u16 opening count, then u8 length + name per opening (opening id i + 1,
+0 meaning none). Only the 64 most common themes get a bit.
+
+rating.idx (little-endian) lists the puzzle indices grouped by rating
+bucket, with a table of where each bucket starts:
+  0  "RIX1"   4  u32 puzzle count   8  u16 rating base   10 u16 bucket width
+  12 u16 bucket count   14 reserved
+  16 bucket count + 1 u32 list positions (bucket b holds ratings from
+     base + b * width, up to the next bucket)
+  then puzzle count x u32 puzzle indices, by bucket, then by index (so a
+  bucket can be read alongside the theme bitmaps in puzzle order)
+
+theme_<theme>.rbm (little-endian) is a compressed bitmap of the puzzles with
+that theme, split into chunks of 65536 puzzles:
+  0  "RBM1"   4  u32 puzzle count   8  u32 puzzles with the theme
+  12 u32 chunk count
+  16 chunk count x 8-byte entries: u32 file offset, u16 container type,
+     u16 value count
+Each chunk is stored as whichever container is smallest:
+  0 array   value count x u16 sorted positions (at most 4096)
+  1 bitmap  one bit per puzzle in the chunk, LSB first (value count 0)
+  2 runs    value count x (u16 start, u16 length - 1)
+theme_<theme>.bit is the uncompressed bitset: one bit per puzzle, LSB first.
 """
 
 from __future__ import annotations
@@ -21,7 +65,17 @@ from dataclasses import dataclass
 
 RECORD_SIZE = 128
 HEADER_SIZE = 18
+CPZ2_HEADER_SIZE = 32
+DEFAULT_BLOCK_RECORDS = 16
+RATING_INDEX_HEADER_SIZE = 16
+RBM_HEADER_SIZE = 16
+RBM_CHUNK_BITS = 65536
+RBM_ARRAY_MAX = 4096
+RBM_ARRAY, RBM_BITMAP, RBM_RUNS = 0, 1, 2
+DEFAULT_RATING_BUCKET = 25
+MAX_RATING_BUCKETS = 1024  # RatingIndex::MAX_BUCKETS
 MAX_MOVES = 24
+MAX_THEMES = 64
 
 
 @dataclass
@@ -46,7 +100,7 @@ def require_python_chess():
 
 
 def parse_args() -> argparse.Namespace:
-    parser = argparse.ArgumentParser(description="Pack puzzles into CPZ1 + theme index bitsets")
+    parser = argparse.ArgumentParser(description="Pack puzzles into CPZ1/CPZ2 + theme index bitsets")
     parser.add_argument("--input", help="Path to lichess_db_puzzle.csv")
     parser.add_argument("--output", required=True, help="Output .cpz file path")
     parser.add_argument("--limit", type=int, default=0, help="Limit puzzle count after filtering")
@@ -54,6 +108,31 @@ def parse_args() -> argparse.Namespace:
     parser.add_argument("--max-rating", type=int, help="Maximum rating filter")
     parser.add_argument("--seed", type=int, help="Seed for deterministic ordering/sampling")
     parser.add_argument("--out-dir", default="assets", help="Assets root (default: assets)")
+    parser.add_argument(
+        "--format",
+        type=int,
+        choices=(1, 2),
+        default=1,
+        help="Pack format: 1 = fixed 128-byte records, 2 = compressed blocks (default: 1)",
+    )
+    parser.add_argument(
+        "--block-records",
+        type=int,
+        default=DEFAULT_BLOCK_RECORDS,
+        help=f"CPZ2 records per block (default: {DEFAULT_BLOCK_RECORDS})",
+    )
+    parser.add_argument(
+        "--theme-index",
+        choices=("rbm", "bit", "both"),
+        default="rbm",
+        help="Theme index files: compressed .rbm bitmaps, plain .bit bitsets, or both (default: rbm)",
+    )
+    parser.add_argument(
+        "--rating-bucket",
+        type=int,
+        default=DEFAULT_RATING_BUCKET,
+        help=f"Rating index bucket width in rating points (default: {DEFAULT_RATING_BUCKET})",
+    )
     parser.add_argument(
         "--starter",
         action="store_true",
@@ -182,7 +261,7 @@ def opening_from_tag(raw: str) -> str:
     return first.replace("_", " ")
 
 
-def record_from_entry(chess_mod, entry: PuzzleEntry) -> tuple[bytes, list[str]]:
+def record_from_entry(chess_mod, entry: PuzzleEntry) -> tuple[bytes, list[str], str]:
     if len(entry.moves_uci) > MAX_MOVES:
         raise ValueError("too_many_moves")
 
@@ -206,7 +285,7 @@ def record_from_entry(chess_mod, entry: PuzzleEntry) -> tuple[bytes, list[str]]:
     record[84:116] = sanitize_field(themes_field, 32)
     record[116:128] = sanitize_field(opening_field, 12)
 
-    return bytes(record), themes
+    return bytes(record), themes, opening_field
 
 
 def load_lichess_csv(path: pathlib.Path) -> list[PuzzleEntry]:
@@ -338,26 +417,100 @@ def apply_filters(entries: list[PuzzleEntry], args: argparse.Namespace) -> list[
     return filtered
 
 
+def build_theme_bitmap(members: list[int], puzzle_count: int) -> bytes:
+    chunk_count = (puzzle_count + RBM_CHUNK_BITS - 1) // RBM_CHUNK_BITS
+    chunks: list[list[int]] = [[] for _ in range(chunk_count)]
+    for idx in sorted(members):
+        chunks[idx // RBM_CHUNK_BITS].append(idx % RBM_CHUNK_BITS)
+
+    directory = bytearray()
+    bodies: list[bytes] = []
+    offset = RBM_HEADER_SIZE + 8 * chunk_count
+    for chunk, values in enumerate(chunks):
+        chunk_bits = min(RBM_CHUNK_BITS, puzzle_count - chunk * RBM_CHUNK_BITS)
+        bitmap = bytearray((chunk_bits + 7) // 8)
+        runs: list[list[int]] = []
+        for value in values:
+            bitmap[value // 8] |= 1 << (value % 8)
+            if runs and runs[-1][0] + runs[-1][1] == value:
+                runs[-1][1] += 1
+            else:
+                runs.append([value, 1])
+
+        # (type, value count, body); the smallest wins, arrays on a tie
+        candidates = [
+            (RBM_BITMAP, 0, bytes(bitmap)),
+            (RBM_RUNS, len(runs), b"".join(struct.pack("<HH", start, length - 1) for start, length in runs)),
+        ]
+        if len(values) <= RBM_ARRAY_MAX:
+            candidates.append((RBM_ARRAY, len(values), struct.pack(f"<{len(values)}H", *values)))
+        kind, count, body = min(candidates, key=lambda c: (len(c[2]), c[0]))
+
+        directory += struct.pack("<IHH", offset, kind, count)
+        bodies.append(body)
+        offset += len(body)
+
+    header = b"RBM1" + struct.pack("<III", puzzle_count, len(members), chunk_count)
+    return header + bytes(directory) + b"".join(bodies)
+
+
 def write_theme_indexes(
     index_root: pathlib.Path,
     pack_name: str,
     puzzle_count: int,
     themes_per_puzzle: list[list[str]],
+    theme_index: str = "rbm",
 ) -> None:
     pack_index_dir = index_root / "index" / pack_name
     pack_index_dir.mkdir(parents=True, exist_ok=True)
 
-    all_themes: set[str] = set()
-    for themes in themes_per_puzzle:
-        all_themes.update(themes)
+    members: dict[str, list[int]] = {}
+    for idx, themes in enumerate(themes_per_puzzle):
+        for theme in set(themes):
+            members.setdefault(theme, []).append(idx)
 
     bitset_size = (puzzle_count + 7) // 8
-    for theme in sorted(all_themes):
-        bitset = bytearray(bitset_size)
-        for idx, themes in enumerate(themes_per_puzzle):
-            if theme in themes:
+    for theme in sorted(members):
+        if theme_index in ("rbm", "both"):
+            bitmap = build_theme_bitmap(members[theme], puzzle_count)
+            (pack_index_dir / f"theme_{theme}.rbm").write_bytes(bitmap)
+        if theme_index in ("bit", "both"):
+            bitset = bytearray(bitset_size)
+            for idx in members[theme]:
                 bitset[idx // 8] |= 1 << (idx % 8)
-        (pack_index_dir / f"theme_{theme}.bit").write_bytes(bytes(bitset))
+            (pack_index_dir / f"theme_{theme}.bit").write_bytes(bytes(bitset))
+
+
+def build_rating_index(ratings: list[int], bucket_width: int) -> bytes:
+    if bucket_width <= 0:
+        raise ValueError("Rating bucket width must be positive")
+
+    base = (min(ratings) // bucket_width) * bucket_width if ratings else 0
+    order = sorted(range(len(ratings)), key=lambda idx: ((ratings[idx] - base) // bucket_width, idx))
+    bucket_count = (max(ratings) - base) // bucket_width + 1 if ratings else 0
+    if bucket_count > MAX_RATING_BUCKETS:
+        raise ValueError(
+            f"{bucket_count} rating buckets, the reader allows {MAX_RATING_BUCKETS}; use a wider --rating-bucket"
+        )
+
+    starts = [0] * (bucket_count + 1)
+    for rating in ratings:
+        starts[(rating - base) // bucket_width + 1] += 1
+    for bucket in range(bucket_count):
+        starts[bucket + 1] += starts[bucket]
+
+    header = bytearray(RATING_INDEX_HEADER_SIZE)
+    header[0:4] = b"RIX1"
+    header[4:8] = struct.pack("<I", len(ratings))
+    header[8:14] = struct.pack("<HHH", base, bucket_width, bucket_count)
+    table = struct.pack(f"<{bucket_count + 1}I", *starts)
+    return bytes(header) + table + struct.pack(f"<{len(order)}I", *order)
+
+
+def write_rating_index(index_root: pathlib.Path, pack_name: str, ratings: list[int], bucket_width: int) -> None:
+    pack_index_dir = index_root / "index" / pack_name
+    pack_index_dir.mkdir(parents=True, exist_ok=True)
+    (pack_index_dir / "rating.idx").write_bytes(build_rating_index(ratings, bucket_width))
 
 
 def build_cpz(records: list[bytes], ratings: list[int]) -> bytes:
@@ -379,9 +532,126 @@ def build_cpz(records: list[bytes], ratings: list[int]) -> bytes:
     return bytes(header) + b"".join(records)
 
 
+def encode_varint(value: int) -> bytes:
+    out = bytearray()
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+    return bytes(out)
+
+
+def compress_record(record: bytes, theme_mask: int, opening_id: int) -> bytes:
+    move_count = record[3]
+    out = bytearray()
+    out.append(record[2])
+    out.append(move_count)
+    out += encode_varint(struct.unpack_from("<H", record, 0)[0])
+
+    occupancy = 0
+    nibbles: list[int] = []
+    for sq in range(64):
+        byte = record[4 + sq // 2]
+        nibble = (byte >> 4) if sq & 1 else (byte & 0x0F)
+        if nibble:
+            occupancy |= 1 << sq
+            nibbles.append(nibble)
+    out += struct.pack("<Q", occupancy)
+    for i in range(0, len(nibbles), 2):
+        high = nibbles[i + 1] if i + 1 < len(nibbles) else 0
+        out.append(nibbles[i] | (high << 4))
+
+    out += record[36 : 36 + move_count * 2]
+    out += encode_varint(theme_mask)
+    out += encode_varint(opening_id)
+    return bytes(out)
+
+
+def encode_name(name: str) -> bytes:
+    payload = name.encode("ascii", errors="ignore")[:255]
+    return bytes([len(payload)]) + payload
+
+
+def build_string_table(
+    themes_per_puzzle: list[list[str]], openings: list[str]
+) -> tuple[dict[str, int], dict[str, int], bytes]:
+    """Theme bits by descending frequency (ties by name) and opening ids by name."""
+    counts: dict[str, int] = {}
+    for themes in themes_per_puzzle:
+        for theme in themes:
+            counts[theme] = counts.get(theme, 0) + 1
+    ranked = sorted(counts, key=lambda t: (-counts[t], t))
+    if len(ranked) > MAX_THEMES:
+        print(f"Warning: {len(ranked)} themes, keeping the {MAX_THEMES} most common")
+        ranked = ranked[:MAX_THEMES]
+    theme_bits = {theme: i for i, theme in enumerate(ranked)}
+
+    opening_names = sorted({o for o in openings if o})
+    if len(opening_names) > 0xFFFF:
+        raise ValueError("Too many distinct openings")
+    opening_ids = {name: i + 1 for i, name in enumerate(opening_names)}
+
+    table = bytearray([len(ranked)])
+    for theme in ranked:
+        table += encode_name(theme)
+    table += struct.pack("<H", len(opening_names))
+    for name in opening_names:
+        table += encode_name(name)
+    return theme_bits, opening_ids, bytes(table)
+
+
+def build_cpz2(
+    records: list[bytes],
+    ratings: list[int],
+    themes_per_puzzle: list[list[str]],
+    openings: list[str],
+    block_records: int,
+) -> bytes:
+    if any(len(r) != RECORD_SIZE for r in records):
+        raise ValueError("All records must be 128 bytes")
+    if not 0 < block_records <= 0xFFFF:
+        raise ValueError("block_records must be 1..65535")
+
+    count = len(records)
+    rating_min = min(ratings) if ratings else 0
+    rating_max = max(ratings) if ratings else 0
+
+    theme_bits, opening_ids, strings = build_string_table(themes_per_puzzle, openings)
+    packed = []
+    for record, themes, opening in zip(records, themes_per_puzzle, openings):
+        mask = 0
+        for theme in themes:
+            if theme in theme_bits:
+                mask |= 1 << theme_bits[theme]
+        packed.append(compress_record(record, mask, opening_ids.get(opening, 0)))
+
+    blocks = [b"".join(packed[i : i + block_records]) for i in range(0, count, block_records)]
+    index_offset = CPZ2_HEADER_SIZE
+    offsets = [index_offset + 4 * (len(blocks) + 1)]
+    for block in blocks:
+        offsets.append(offsets[-1] + len(block))
+
+    header = bytearray(CPZ2_HEADER_SIZE)
+    header[0:4] = b"CPZ2"
+    header[4:6] = struct.pack("<H", RECORD_SIZE)
+    header[6:10] = struct.pack("<I", count)
+    header[10:12] = struct.pack("<H", rating_min)
+    header[12:14] = struct.pack("<H", rating_max)
+    header[14:16] = struct.pack("<H", block_records)
+    header[16:20] = struct.pack("<I", len(blocks))
+    header[20:24] = struct.pack("<I", index_offset)
+    header[24:28] = struct.pack("<I", offsets[-1])
+
+    index = b"".join(struct.pack("<I", offset) for offset in offsets)
+    return bytes(header) + index + b"".join(blocks) + strings
+
+
 def inspect_blob(blob: bytes) -> None:
     if len(blob) < HEADER_SIZE:
         raise SystemExit("CPZ output too small")
+    if blob[0:4] == b"CPZ2":
+        inspect_blob_v2(blob)
+        return
     if blob[0:4] != b"CPZ1":
         raise SystemExit("CPZ magic mismatch")
 
@@ -399,6 +669,25 @@ def inspect_blob(blob: bytes) -> None:
             raise SystemExit("First record moveCount exceeds MAX_MOVES")
 
 
+def inspect_blob_v2(blob: bytes) -> None:
+    if len(blob) < CPZ2_HEADER_SIZE:
+        raise SystemExit("CPZ2 output too small")
+
+    puzzle_count = struct.unpack_from("<I", blob, 6)[0]
+    block_records = struct.unpack_from("<H", blob, 14)[0]
+    block_count = struct.unpack_from("<I", blob, 16)[0]
+    index_offset = struct.unpack_from("<I", blob, 20)[0]
+    if block_count != (puzzle_count + block_records - 1) // block_records:
+        raise SystemExit("CPZ2 block count does not match puzzle count")
+
+    strings_offset = struct.unpack_from("<I", blob, 24)[0]
+    offsets = struct.unpack_from(f"<{block_count + 1}I", blob, index_offset)
+    if offsets[-1] != strings_offset or list(offsets) != sorted(offsets):
+        raise SystemExit("CPZ2 block index is inconsistent")
+    if strings_offset >= len(blob):
+        raise SystemExit("CPZ2 string table missing")
+
+
 def main() -> None:
     args = parse_args()
 
@@ -416,12 +705,13 @@ def main() -> None:
 
     records: list[bytes] = []
     themes_per_puzzle: list[list[str]] = []
+    openings: list[str] = []
     ratings: list[int] = []
     skipped = 0
 
     for entry in entries:
         try:
-            record, themes = record_from_entry(chess, entry)
+            record, themes, opening = record_from_entry(chess, entry)
         except ValueError as exc:
             if str(exc) == "too_many_moves":
                 skipped += 1
@@ -430,17 +720,22 @@ def main() -> None:
             continue
         records.append(record)
         themes_per_puzzle.append(themes)
+        openings.append(opening)
         ratings.append(entry.rating)
 
     out_path = pathlib.Path(args.output)
     out_path.parent.mkdir(parents=True, exist_ok=True)
 
-    cpz_blob = build_cpz(records, ratings)
+    if args.format == 2:
+        cpz_blob = build_cpz2(records, ratings, themes_per_puzzle, openings, args.block_records)
+    else:
+        cpz_blob = build_cpz(records, ratings)
     inspect_blob(cpz_blob)
     out_path.write_bytes(cpz_blob)
 
     pack_name = out_path.stem
-    write_theme_indexes(pathlib.Path(args.out_dir), pack_name, len(records), themes_per_puzzle)
+    write_theme_indexes(pathlib.Path(args.out_dir), pack_name, len(records), themes_per_puzzle, args.theme_index)
+    write_rating_index(pathlib.Path(args.out_dir), pack_name, ratings, args.rating_bucket)
 
     print(
         f"Wrote {out_path} ({len(records)} puzzles, {len(cpz_blob)} bytes). "
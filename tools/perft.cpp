@@ -0,0 +1,257 @@
+// Host-side perft harness for ChessCore.
+//
+// Counts leaf nodes of the legal move tree for reference positions and
+// compares them with published values, then reports throughput. Used as a
+// regression gate (ctest) and as the benchmark for move-generator changes.
+//
+//   perft                           run the reference suite
+//   perft --verify                  also check make/unmake, incremental state
+//                                   and isLegalMove()
+//   perft --depth-limit N           cap every suite entry at depth N
+//   perft --fen "<FEN>" --depth N   count a single position
+//   perft --fen "<FEN>" --depth N --divide
+
+#include "ChessCore.h"
+#include "fen.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using Chess::Bitboard;
+using Chess::BoardState;
+using Chess::Move;
+using Chess::MoveList;
+using Chess::UndoInfo;
+
+namespace {
+
+struct SuiteEntry {
+    const char* name;
+    const char* fen;
+    int depth;
+    uint64_t nodes[8];  // Expected counts for depth 1..depth
+};
+
+// Reference values from the Chess Programming Wiki perft pages and the
+// "perftsuite" collection of ep / castling / promotion edge cases.
+const SuiteEntry SUITE[] = {
+    {"start", "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", 5,
+     {20, 400, 8902, 197281, 4865609}},
+    {"kiwipete", "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1", 4,
+     {48, 2039, 97862, 4085603}},
+    {"position3", "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1", 5,
+     {14, 191, 2812, 43238, 674624}},
+    {"position4", "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1", 4,
+     {6, 264, 9467, 422333}},
+    {"position5", "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8", 4,
+     {44, 1486, 62379, 2103487}},
+    {"position6", "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4,
+     {46, 2079, 89890, 3894594}},
+    {"ep-pin-rank", "3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1", 6,
+     {18, 92, 1670, 10138, 185429, 1134888}},
+    {"ep-discover", "8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1", 6,
+     {15, 126, 1928, 13931, 206379, 1440467}},
+    {"ep-bishop", "8/8/4k3/8/2p5/8/B2P2K1/8 w - - 0 1", 6,
+     {13, 102, 1266, 10276, 135655, 1015133}},
+    {"castle-short", "5k2/8/8/8/8/8/8/4K2R w K - 0 1", 6,
+     {15, 66, 1198, 6399, 120330, 661072}},
+    {"castle-long", "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1", 6,
+     {16, 71, 1286, 7418, 141077, 803711}},
+    {"castle-rights", "r3k2r/1b4bq/8/8/8/8/7B/R3K2R w KQkq - 0 1", 4,
+     {26, 1141, 27826, 1274206}},
+    {"castle-check", "r3k2r/8/3Q4/8/8/5q2/8/R3K2R b KQkq - 0 1", 4,
+     {44, 1494, 50509, 1720476}},
+    {"promo-check", "2K2r2/4P3/8/8/8/8/8/3k4 w - - 0 1", 6,
+     {11, 133, 1442, 19174, 266199, 3821001}},
+    {"promo-under", "4k3/1P6/8/8/8/8/K7/8 w - - 0 1", 6,
+     {9, 40, 472, 2661, 38983, 217342}},
+    {"promo-both", "n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1", 5,
+     {24, 496, 9483, 182838, 3605103}},
+    {"self-stalemate", "K1k5/8/P7/8/8/8/8/8 w - - 0 1", 6,
+     {2, 6, 13, 63, 382, 2217}},
+    {"discovered-check", "8/8/1P2K3/8/2n5/1q6/8/5k2 b - - 0 1", 5,
+     {29, 165, 5160, 31961, 1004658}},
+};
+
+bool verifyMode = false;
+int verifyFailures = 0;
+
+bool sameState(const BoardState& a, const BoardState& b) {
+    return memcmp(a.board, b.board, sizeof(a.board)) == 0 &&
+           memcmp(a.typeBB, b.typeBB, sizeof(a.typeBB)) == 0 &&
+           memcmp(a.colorBB, b.colorBB, sizeof(a.colorBB)) == 0 &&
+           memcmp(a.kingSq, b.kingSq, sizeof(a.kingSq)) == 0 &&
+           memcmp(a.pieceCount, b.pieceCount, sizeof(a.pieceCount)) == 0 &&
+           memcmp(a.material, b.material, sizeof(a.material)) == 0 && a.key == b.key &&
+           a.whiteToMove == b.whiteToMove && a.castling == b.castling &&
+           a.epSquare == b.epSquare && a.halfmoveClock == b.halfmoveClock &&
+           a.fullmoveNum == b.fullmoveNum;
+}
+
+void reportFailure(const char* what, const Move& m) {
+    if (verifyFailures++ < 10) {
+        printf("  VERIFY FAILED: %s after %s\n", what, moveToUci(m).c_str());
+    }
+}
+
+// isLegalMove() must accept exactly the generated moves. Every from/to pair
+// for the side to move is tried, with each promotion piece where relevant.
+// Generated moves must also carry the right kind flags.
+void verifyLegality(const BoardState& state, const MoveList& moves) {
+    for (const Move& m : moves) {
+        const int type = Chess::pieceType(state.at(m.from()));
+        const int distance = m.to() > m.from() ? m.to() - m.from() : m.from() - m.to();
+        const bool ep = type == Chess::PAWN && m.to() == state.epSquare;
+        int flags = 0;
+        if (state.at(m.to()) != Chess::NONE || ep) flags |= Move::CAPTURE;
+        if (ep) flags |= Move::EN_PASSANT;
+        if (type == Chess::KING && distance == 2) flags |= Move::CASTLE;
+        if (type == Chess::PAWN && distance == 16) flags |= Move::DOUBLE_PUSH;
+        if (m.flags() != flags) reportFailure("move flags", m);
+    }
+
+    Bitboard ours = state.pieces(state.whiteToMove);
+    while (ours) {
+        int from = Chess::popLsb(ours);
+        for (int to = 0; to < 64; to++) {
+            for (uint8_t promo = 0; promo <= 4; promo++) {
+                Move m(from, to, promo);
+                if (state.isLegalMove(m) != moves.contains(m)) reportFailure("isLegalMove", m);
+            }
+        }
+    }
+}
+
+uint64_t perft(BoardState& state, int depth) {
+    MoveList moves;
+    state.generateLegalMoves(moves);
+    if (depth == 1 && !verifyMode) return moves.size();
+    if (verifyMode && depth > 1) verifyLegality(state, moves);
+
+    uint64_t nodes = 0;
+    UndoInfo undo;
+    for (const Move& m : moves) {
+        BoardState before;
+        if (verifyMode) before = state;
+
+        state.makeMove(m, undo);
+        if (verifyMode) {
+            BoardState rebuilt = state;
+            rebuilt.rebuildDerivedState();
+            if (!sameState(rebuilt, state)) reportFailure("incremental state", m);
+        }
+        nodes += depth > 1 ? perft(state, depth - 1) : 1;
+        state.unmakeMove(undo);
+
+        if (verifyMode && !sameState(before, state)) reportFailure("unmake", m);
+    }
+    return nodes;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int runSuite(int depthLimit) {
+    int failures = 0;
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0;
+
+    for (const SuiteEntry& entry : SUITE) {
+        BoardState state;
+        if (!parseFen(entry.fen, state)) {
+            printf("%-18s bad FEN\n", entry.name);
+            failures++;
+            continue;
+        }
+
+        int depth = entry.depth < depthLimit ? entry.depth : depthLimit;
+        uint64_t expected = entry.nodes[depth - 1];
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t nodes = perft(state, depth);
+        double seconds = secondsSince(start);
+
+        totalNodes += nodes;
+        totalSeconds += seconds;
+        bool ok = nodes == expected;
+        if (!ok) failures++;
+
+        printf("%-18s d%d %12llu %s  %7.3fs\n", entry.name, depth, static_cast<unsigned long long>(nodes),
+               ok ? "ok      " : "MISMATCH", seconds);
+        if (!ok) {
+            printf("  expected %llu\n", static_cast<unsigned long long>(expected));
+        }
+    }
+
+    printf("total %llu nodes in %.3fs (%.0f nodes/s)\n", static_cast<unsigned long long>(totalNodes), totalSeconds,
+           totalSeconds > 0 ? totalNodes / totalSeconds : 0.0);
+    if (verifyMode) {
+        printf("verify: %d failure(s)\n", verifyFailures);
+    }
+    return failures + verifyFailures;
+}
+
+int runSingle(const char* fen, int depth, bool divide) {
+    BoardState state;
+    if (!parseFen(fen, state)) {
+        fprintf(stderr, "bad FEN: %s\n", fen);
+        return 2;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t total = 0;
+    if (divide) {
+        MoveList moves;
+        state.generateLegalMoves(moves);
+        UndoInfo undo;
+        for (const Move& m : moves) {
+            state.makeMove(m, undo);
+            uint64_t nodes = depth > 1 ? perft(state, depth - 1) : 1;
+            state.unmakeMove(undo);
+            printf("%s: %llu\n", moveToUci(m).c_str(), static_cast<unsigned long long>(nodes));
+            total += nodes;
+        }
+    } else {
+        total = perft(state, depth);
+    }
+    double seconds = secondsSince(start);
+
+    printf("nodes %llu in %.3fs (%.0f nodes/s)\n", static_cast<unsigned long long>(total), seconds,
+           seconds > 0 ? total / seconds : 0.0);
+    return verifyFailures;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const char* fen = nullptr;
+    int depth = 0;
+    int depthLimit = 8;
+    bool divide = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0) {
+            verifyMode = true;
+        } else if (strcmp(argv[i], "--divide") == 0) {
+            divide = true;
+        } else if (strcmp(argv[i], "--fen") == 0 && i + 1 < argc) {
+            fen = argv[++i];
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--depth-limit") == 0 && i + 1 < argc) {
+            depthLimit = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--verify] [--depth-limit N] [--fen FEN --depth N [--divide]]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (fen) {
+        return runSingle(fen, depth > 0 ? depth : 1, divide) == 0 ? 0 : 1;
+    }
+    return runSuite(depthLimit > 0 ? depthLimit : 1) == 0 ? 0 : 1;
+}
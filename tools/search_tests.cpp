@@ -0,0 +1,169 @@
+// Host-side checks for the search.
+//
+// Runs Search on small positions with a known answer: a hanging piece the
+// alpha-beta search must take, and mates in one and two for the checks-only
+// mate solver, including one with two mating moves. The mate scores of run()
+// and scoreMove() must agree. Also checks the static
+// exchange results the move ordering uses to put losing captures last.
+// Run by ctest.
+//
+//   search_tests
+
+#include "ChessCore.h"
+#include "ChessSearch.h"
+#include "fen.h"
+
+#include <cstdio>
+#include <string>
+
+using Chess::BoardState;
+using Chess::Move;
+using Chess::MoveList;
+
+namespace {
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    printf("  FAILED: %s\n", what.c_str());
+    failures++;
+}
+
+bool load(const char* fen, BoardState& state) {
+    if (parseFen(fen, state)) return true;
+    check(false, std::string("bad FEN ") + fen);
+    return false;
+}
+
+// The legal move with the given UCI text, or a null move
+Move legalMove(const BoardState& state, const char* uci) {
+    MoveList moves;
+    state.generateLegalMoves(moves);
+    for (const Move& m : moves) {
+        if (moveToUci(m) == uci) return m;
+    }
+    check(false, std::string("no legal move ") + uci);
+    return Move();
+}
+
+void testRun(Chess::Search& search) {
+    // Undefended queen in front of the rook
+    BoardState state;
+    if (!load("4k3/8/8/3q4/8/8/8/3RK3 w - - 0 1", state)) return;
+
+    const Chess::SearchResult result = search.run(state, Chess::SearchLimits());
+    check(result.bestMove == legalMove(state, "d1d5"), "run: best move " + moveToUci(result.bestMove));
+    check(result.score > 0, "run: score " + std::to_string(result.score));
+    check(result.depth > 0, "run: no iteration completed");
+}
+
+void testFindMates(Chess::Search& search) {
+    struct Case {
+        const char* fen;
+        int mateIn;
+        const char* mates[2];
+    };
+    const Case cases[] = {
+        // Back rank
+        {"6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1", 1, {"a1a8", nullptr}},
+        // Either rook mates on the back rank
+        {"6k1/5ppp/8/8/8/8/8/RR4K1 w - - 0 1", 1, {"a1a8", "b1b8"}},
+        // Re8+ Rxe8 Rxe8#
+        {"r5k1/5ppp/8/8/8/8/4RPPP/4R1K1 w - - 0 1", 2, {"e2e8", nullptr}},
+    };
+
+    for (const Case& c : cases) {
+        BoardState state;
+        if (!load(c.fen, state)) continue;
+
+        MoveList mates;
+        const Chess::MateResult result = search.findMates(state, 3, Chess::SearchLimits(), mates);
+        const std::string name = c.fen;
+        check(!result.aborted, name + ": aborted");
+        check(result.mateIn == c.mateIn, name + ": mate in " + std::to_string(result.mateIn));
+
+        int expected = 0;
+        for (const char* uci : c.mates) {
+            if (!uci) continue;
+            check(mates.contains(legalMove(state, uci)), name + ": missed " + uci);
+            expected++;
+        }
+        check(static_cast<int>(mates.size()) == expected, name + ": " + std::to_string(mates.size()) + " mating moves");
+    }
+
+    // Nothing to find without a mate
+    BoardState state;
+    if (load("4k3/8/8/3q4/8/8/8/3RK3 w - - 0 1", state)) {
+        MoveList mates;
+        const Chess::MateResult result = search.findMates(state, 2, Chess::SearchLimits(), mates);
+        check(result.mateIn == 0 && mates.empty(), "findMates: mate found without one");
+    }
+}
+
+void testScoreMove(Chess::Search& search) {
+    const char* fens[] = {
+        "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1",
+        "r5k1/5ppp/8/8/8/8/4RPPP/4R1K1 w - - 0 1",
+    };
+    const int mateIn[] = {1, 2};
+
+    for (int i = 0; i < 2; i++) {
+        BoardState state;
+        if (!load(fens[i], state)) continue;
+
+        search.clear();
+        const Chess::SearchResult best = search.run(state, Chess::SearchLimits());
+        const std::string name = fens[i];
+        check(best.score == Chess::MATE_SCORE - (2 * mateIn[i] - 1), name + ": run score " + std::to_string(best.score));
+
+        search.clear();
+        const Chess::SearchResult scored = search.scoreMove(state, best.bestMove, Chess::SearchLimits());
+        check(scored.score == best.score, name + ": scoreMove score " + std::to_string(scored.score));
+    }
+}
+
+void testSee() {
+    using Chess::PIECE_VALUES;
+    struct Case {
+        const char* fen;
+        const char* move;
+        int expected;
+    };
+    const Case cases[] = {
+        // Queen takes a pawn defended by a pawn: losing
+        {"4k3/8/2p5/3p4/8/8/8/3QK3 w - - 0 1", "d1d5", PIECE_VALUES[Chess::PAWN] - PIECE_VALUES[Chess::QUEEN]},
+        // Rook takes an undefended knight
+        {"4k3/8/8/3n4/8/8/8/3RK3 w - - 0 1", "d1d5", PIECE_VALUES[Chess::KNIGHT]},
+        // Knight for knight
+        {"4k3/8/2p5/3n4/8/4N3/8/4K3 w - - 0 1", "e3d5", 0},
+        // Pawn takes a defended queen
+        {"3rk3/8/8/3q4/4P3/8/8/4K3 w - - 0 1", "e4d5", PIECE_VALUES[Chess::QUEEN] - PIECE_VALUES[Chess::PAWN]},
+        // Rook takes a pawn defended by a rook, with a second rook behind it
+        {"3rk3/8/8/3p4/8/8/3R4/3RK3 w - - 0 1", "d2d5", PIECE_VALUES[Chess::PAWN]},
+        // The same with a single rook: losing
+        {"3rk3/8/8/3p4/8/8/8/3RK3 w - - 0 1", "d1d5", PIECE_VALUES[Chess::PAWN] - PIECE_VALUES[Chess::ROOK]},
+    };
+
+    for (const Case& c : cases) {
+        BoardState state;
+        if (!load(c.fen, state)) continue;
+        const int see = state.see(legalMove(state, c.move));
+        check(see == c.expected, std::string(c.fen) + ": see " + std::to_string(see));
+    }
+}
+
+}  // namespace
+
+int main() {
+    Chess::Search search;
+    search.resizeTable(64 * 1024);
+
+    testRun(search);
+    testFindMates(search);
+    testScoreMove(search);
+    testSee();
+    printf("search: %s\n", failures == 0 ? "ok" : "FAILED");
+
+    return failures == 0 ? 0 : 1;
+}
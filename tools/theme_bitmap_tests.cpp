@@ -0,0 +1,255 @@
+// Host-side checks for ThemeBitmap.
+//
+// Decodes the starter pack's .rbm theme indexes and compares every chunk bit
+// for bit with the plain .bit encoding of the same theme (kept in
+// tools/testdata/starter), then does the same for generated indexes that use
+// each container type, an empty theme and a partial last chunk, read both
+// as .rbm and through the .bit fallback. Files are served by the stand-ins
+// in tools/host_stubs. Run by ctest.
+//
+//   theme_bitmap_tests <repository root>
+
+#include "ChessCore.h"
+#include "ThemeBitmap.h"
+
+#include <SDCardManager.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Container types, as documented in tools/pack_lichess_cpz.py
+enum Kind : uint16_t { ARRAY = 0, BITMAP = 1, RUNS = 2 };
+
+int failures = 0;
+
+void check(bool ok, const std::string& what) {
+    if (ok) return;
+    if (failures < 20) {
+        printf("  FAILED: %s\n", what.c_str());
+    }
+    failures++;
+}
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+void putU16(std::vector<uint8_t>& out, uint32_t v) {
+    out.push_back(v & 0xFF);
+    out.push_back((v >> 8) & 0xFF);
+}
+
+void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    putU16(out, v & 0xFFFF);
+    putU16(out, v >> 16);
+}
+
+// .bit encoding: LSB-first, one bit per puzzle
+std::vector<uint8_t> encodeBit(const std::vector<bool>& members) {
+    std::vector<uint8_t> out((members.size() + 7) / 8);
+    for (size_t i = 0; i < members.size(); i++) {
+        if (members[i]) out[i / 8] |= 1 << (i % 8);
+    }
+    return out;
+}
+
+// .rbm encoding with the container type of each chunk given, rather than
+// the smallest one the packer would choose
+std::vector<uint8_t> encodeRbm(const std::vector<bool>& members, const std::vector<Kind>& kinds) {
+    const uint32_t puzzles = static_cast<uint32_t>(members.size());
+    const uint32_t chunks = static_cast<uint32_t>(kinds.size());
+    std::vector<uint8_t> directory;
+    std::vector<uint8_t> bodies;
+    uint32_t memberCount = 0;
+    for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+        const uint32_t first = chunk * ThemeBitmap::CHUNK_BITS;
+        const uint32_t chunkBits = std::min(ThemeBitmap::CHUNK_BITS, puzzles - first);
+        std::vector<uint8_t> body;
+        uint32_t count = 0;
+        if (kinds[chunk] == BITMAP) {
+            const std::vector<bool> slice(members.begin() + first, members.begin() + first + chunkBits);
+            body = encodeBit(slice);
+        }
+        for (uint32_t i = 0; i < chunkBits; i++) {
+            if (!members[first + i]) continue;
+            memberCount++;
+            if (kinds[chunk] == ARRAY) {
+                putU16(body, i);
+                count++;
+            } else if (kinds[chunk] == RUNS && (i == 0 || !members[first + i - 1])) {
+                uint32_t end = i + 1;
+                while (end < chunkBits && members[first + end]) end++;
+                putU16(body, i);
+                putU16(body, end - i - 1);
+                count++;
+            }
+        }
+        putU32(directory, 0);  // Offset, patched below
+        putU16(directory, kinds[chunk]);
+        putU16(directory, count);
+        const uint32_t offset = static_cast<uint32_t>(ThemeBitmap::HEADER_SIZE + 8 * chunks + bodies.size());
+        for (int b = 0; b < 4; b++) {
+            directory[8 * chunk + b] = static_cast<uint8_t>(offset >> (8 * b));
+        }
+        bodies.insert(bodies.end(), body.begin(), body.end());
+    }
+
+    std::vector<uint8_t> out = {'R', 'B', 'M', '1'};
+    putU32(out, puzzles);
+    putU32(out, memberCount);
+    putU32(out, chunks);
+    out.insert(out.end(), directory.begin(), directory.end());
+    out.insert(out.end(), bodies.begin(), bodies.end());
+    return out;
+}
+
+// Open basePath and compare every chunk with the .bit image
+void compareWithBit(const std::string& basePath, const std::vector<uint8_t>& bit, uint32_t puzzles,
+                    bool expectCompressed, const std::string& name) {
+    ThemeBitmap bitmap;
+    if (!bitmap.open(basePath, puzzles)) {
+        check(false, name + ": open");
+        return;
+    }
+    check(bitmap.compressed() == expectCompressed, name + ": format");
+    const uint32_t chunks = (puzzles + ThemeBitmap::CHUNK_BITS - 1) / ThemeBitmap::CHUNK_BITS;
+    check(bitmap.chunkCount() == chunks, name + ": chunk count");
+
+    Bitset out;
+    for (uint32_t chunk = 0; chunk < bitmap.chunkCount(); chunk++) {
+        const std::string where = name + " chunk " + std::to_string(chunk);
+        if (!bitmap.readChunk(chunk, out)) {
+            check(false, where + ": read");
+            continue;
+        }
+        const uint32_t first = chunk * ThemeBitmap::CHUNK_BITS;
+        const uint32_t chunkBits = std::min(ThemeBitmap::CHUNK_BITS, puzzles - first);
+        check(out.size() == chunkBits, where + ": size");
+
+        bool same = true;
+        bool any = false;
+        for (uint32_t i = 0; i < chunkBits; i++) {
+            const bool expected = (bit[(first + i) / 8] >> ((first + i) % 8)) & 1;
+            same = same && out.test(i) == expected;
+            any = any || expected;
+        }
+        check(same, where + ": bits");
+        if (chunkBits % Bitset::WORD_BITS) {
+            check((out.word(out.wordCount() - 1) >> (chunkBits % Bitset::WORD_BITS)) == 0, where + ": past end");
+        }
+        if (any) check(bitmap.chunkMayHaveBits(chunk), where + ": skipped");
+    }
+}
+
+void testStarter(const std::string& root) {
+    const std::string indexDir = root + "/assets/index/starter";
+    const std::string bitDir = root + "/tools/testdata/starter";
+
+    const std::vector<uint8_t> pack = readFile(root + "/assets/packs/starter.cpz");
+    Chess::PackHeader header;
+    if (!Chess::PackHeader::fromFile(pack.data(), pack.size(), header)) {
+        check(false, "starter: pack header");
+        return;
+    }
+
+    int themes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(indexDir)) {
+        if (entry.path().extension() != ".rbm") continue;
+        const std::string stem = entry.path().stem().string();
+        const std::vector<uint8_t> bit = readFile(bitDir + "/" + stem + ".bit");
+        if (bit.size() != (header.puzzleCount + 7) / 8) {
+            check(false, stem + ": no matching .bit");
+            continue;
+        }
+        compareWithBit(indexDir + "/" + stem, bit, header.puzzleCount, true, stem);
+        themes++;
+    }
+    check(themes > 0, "starter: no themes found");
+    printf("starter: %d themes\n", themes);
+}
+
+void testGenerated() {
+    // Three full chunks and a partial one
+    const uint32_t puzzles = 3 * ThemeBitmap::CHUNK_BITS + 1234;
+    std::mt19937 rng(7);
+
+    std::vector<bool> mixed(puzzles);
+    for (uint32_t i = 0; i < ThemeBitmap::CHUNK_BITS; i += 1 + rng() % 40) mixed[i] = true;
+    for (uint32_t i = ThemeBitmap::CHUNK_BITS; i < 2 * ThemeBitmap::CHUNK_BITS; i++) mixed[i] = rng() % 2;
+    for (uint32_t start = 2 * ThemeBitmap::CHUNK_BITS; start + 3000 <= 3 * ThemeBitmap::CHUNK_BITS; start += 5000) {
+        const uint32_t length = 1000 + rng() % 2000;
+        for (uint32_t i = start; i < start + length; i++) mixed[i] = true;
+    }
+    // Runs in the last chunk, one of them ending on the last puzzle
+    for (uint32_t i = 3 * ThemeBitmap::CHUNK_BITS; i < 3 * ThemeBitmap::CHUNK_BITS + 10; i++) mixed[i] = true;
+    for (uint32_t i = puzzles - 100; i < puzzles; i++) mixed[i] = true;
+
+    std::vector<bool> lastOnly(puzzles);
+    for (uint32_t i = 3 * ThemeBitmap::CHUNK_BITS; i < puzzles; i += 3) lastOnly[i] = true;
+    lastOnly[puzzles - 1] = true;
+
+    const std::vector<bool> empty(puzzles);
+
+    struct Case {
+        const char* name;
+        const std::vector<bool>& members;
+        std::vector<Kind> kinds;
+    };
+    const Case cases[] = {
+        {"mixed", mixed, {ARRAY, BITMAP, RUNS, RUNS}},
+        {"mixed_bitmaps", mixed, {BITMAP, BITMAP, BITMAP, BITMAP}},
+        {"last_bitmap", lastOnly, {ARRAY, ARRAY, ARRAY, BITMAP}},
+        {"last_array", lastOnly, {RUNS, RUNS, RUNS, ARRAY}},
+        {"empty", empty, {ARRAY, ARRAY, ARRAY, ARRAY}},
+    };
+
+    for (const Case& c : cases) {
+        const std::string base = std::string("/generated/theme_") + c.name;
+        const std::vector<uint8_t> bit = encodeBit(c.members);
+        SdMan.addFile(base + ".rbm", encodeRbm(c.members, c.kinds));
+        SdMan.addFile(base + ".bit", bit);
+        compareWithBit(base, bit, puzzles, true, c.name);
+
+        // Without the .rbm, the same theme is read from the .bit file
+        SdMan.removeFile(base + ".rbm");
+        compareWithBit(base, bit, puzzles, false, std::string(c.name) + " (.bit)");
+    }
+
+    // An empty .rbm lets a query skip every chunk without reading it
+    SdMan.addFile("/generated/theme_empty.rbm", encodeRbm(empty, {ARRAY, ARRAY, ARRAY, ARRAY}));
+    ThemeBitmap bitmap;
+    check(bitmap.open("/generated/theme_empty", puzzles), "empty: open");
+    for (uint32_t chunk = 0; chunk < bitmap.chunkCount(); chunk++) {
+        check(!bitmap.chunkMayHaveBits(chunk), "empty: chunk " + std::to_string(chunk) + " may have bits");
+    }
+
+    // A file built for another pack size is refused
+    SdMan.addFile("/generated/theme_mixed.rbm", encodeRbm(mixed, {ARRAY, BITMAP, RUNS, RUNS}));
+    check(!bitmap.open("/generated/theme_mixed", puzzles + 1), "mixed: opened with the wrong puzzle count");
+    check(!bitmap.open("/generated/theme_missing", puzzles), "missing: opened");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <repository root>\n", argv[0]);
+        return 2;
+    }
+
+    testStarter(argv[1]);
+    testGenerated();
+    printf("theme bitmap: %s\n", failures == 0 ? "ok" : "FAILED");
+
+    return failures == 0 ? 0 : 1;
+}